@@ -4,29 +4,24 @@
 #include "hsh_fitter.h"
 
 
+/* Axis rectification of a capture : the rotation that makes the axis in 'str_axis_filename' */
+/* upright. It is no longer applied by rewriting the images, the fitter rotates every block	 */
+/* of rows as it reads them (the color correction is the fitter's correction file).			 */
 class AxisRectify
 {
 public:
 	string str_main_path;
-	string str_prefix;
-	string str_correction_filename;
 	string str_axis_filename;
 
 	bool do_rectification;
-	bool do_color_correction;
 
-	AxisRectify(string instr_main_path, string instr_prefix, string instr_correction_filename, string instr_axis_filename);
+	AxisRectify(string instr_main_path, string instr_axis_filename);
 
 	void read_axis_rot();
-	void read_color_correction();
 
-	bool full_rectification_loop();
+	void apply(HshFitter & fitter); // hands the rotation to the fitter, if the axis file was read
 
 	double rot_angle;
-
-	double color_fix[3][200];
-
-	int num_lights;
 };
 
 
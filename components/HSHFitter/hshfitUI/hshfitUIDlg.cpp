@@ -4,6 +4,7 @@
 #include "stdafx.h"
 #include "hshfitUI.h"
 #include "hshfitUIDlg.h"
+#include "../HSHfit/axis_rectify.h"
 
 #include "boost/filesystem.hpp"  
 
@@ -307,6 +308,13 @@ void ChshfitUIDlg::OnBnClickedButtonProcess()
 		
 		hshfitter->set_output_filename(outputfilename);
 
+		if (!strRectifyFile.IsEmpty()) // the fitter rotates the rows as it reads them, the images are left untouched
+		{
+			AxisRectify rectify(hshfitter->get_main_path(), tostr(strRectifyFile));
+			rectify.read_axis_rot();
+			rectify.apply(*hshfitter);
+		}
+
 		if (hshfitter->read_inputs()) 
 		{
 			hshfitter->compute_loop();
@@ -438,12 +446,29 @@ void ChshfitUIDlg::OnBnClickedButtonScan()
 
 void ChshfitUIDlg::OnBnClickedButtonRectifyFile()
 {
-	// TODO: Add your control notification handler code here
+	UpdateData(true);
+	CFileDialog dlgFile(true,"*.txt",strRectifyFile, OFN_OVERWRITEPROMPT ,"Axis Files (*.txt)|*.txt|");
+	if (dlgFile.DoModal()==IDOK) 
+	{
+		strRectifyFile = dlgFile.GetFileName();
+	}
+	UpdateData(false);
 }
 
 void ChshfitUIDlg::OnBnClickedButtonRectify()
 {
-	// TODO: Add your control notification handler code here
+	UpdateData(true);
+	AxisRectify rectify(tostr(strMainPath) + "/", tostr(strRectifyFile));
+	rectify.read_axis_rot();
+	if (rectify.do_rectification)
+	{
+		CString strAngle;
+		strAngle.Format("Rectification : rotation of %.2f degrees, applied to the images while they are fitted \r\n", rectify.rot_angle);
+		strStatus += strAngle;
+	}
+	else
+		strStatus += "Axis file invalid, the images will not be rectified! \r\n";
+	UpdateData(false);
 }
 
 void ChshfitUIDlg::OnBnClickedButtonMrti()
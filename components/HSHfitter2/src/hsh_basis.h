@@ -0,0 +1,104 @@
+/*  HSHFitter
+ *  Copyright (C) 2009-11 UC Santa Cruz and Cultural Heritage Imaging
+ *
+ *  Portions Copyright (C) 2010-11 Univ. do Minho and Cultural Heritage Imaging
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 3 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Hemispherical harmonics basis, shared by the fitter and the viewer (RTIViewer includes
+ * this header from util.h), so both sides always agree on the term order and normalization.
+ * Header only and without dependencies on purpose.
+ */
+
+#ifndef _HSH_BASIS_H
+#define	_HSH_BASIS_H
+
+#include <math.h>
+
+#define HSH_MAX_ORDER 4
+#define HSH_MAX_TERMS (HSH_MAX_ORDER*HSH_MAX_ORDER)
+
+/*
+ * Every term has the form  norm * A(phi) * s^power * P(c)  with c = cos(theta),
+ * s = sqrt(c - c^2), A(phi) = cos(m*phi) for m > 0, sin(-m*phi) for m < 0, 1 for m = 0
+ * and P(c) = poly[0] + poly[1]*c + poly[2]*c^2 + poly[3]*c^3.
+ */
+struct HshTerm {
+	double norm;
+	int m;
+	int power;
+	double poly[4];
+};
+
+static const HshTerm hsh_terms_table[HSH_MAX_TERMS] = {
+	// order 1
+	{ 0.398942280401433,  0, 0, {  1,   0,   0,  0 } },	// 1/sqrt(2*PI)
+	// order 2
+	{ 1.381976597885342,  1, 1, {  1,   0,   0,  0 } },	// sqrt(6/PI)
+	{ 0.690988298942671,  0, 0, { -1,   2,   0,  0 } },	// sqrt(3/(2*PI))
+	{ 1.381976597885342, -1, 1, {  1,   0,   0,  0 } },	// sqrt(6/PI)
+	// order 3
+	{ 3.090193616185517,  2, 0, {  0,  -1,   1,  0 } },	// sqrt(30/PI)
+	{ 3.090193616185517,  1, 1, { -1,   2,   0,  0 } },	// sqrt(30/PI)
+	{ 0.892062058076386,  0, 0, {  1,  -6,   6,  0 } },	// sqrt(5/(2*PI))
+	{ 3.090193616185517, -1, 1, { -1,   2,   0,  0 } },	// sqrt(30/PI)
+	{ 3.090193616185517, -2, 0, {  0,  -1,   1,  0 } },	// sqrt(30/PI)
+	// order 4
+	{ 6.675581178124546,  3, 3, {  1,   0,   0,  0 } },	// 2*sqrt(35/PI)
+	{ 8.175883811466258,  2, 0, {  0,   1,  -3,  2 } },	// sqrt(210/PI)
+	{ 5.170882945826411,  1, 1, {  1,  -5,   5,  0 } },	// 2*sqrt(21/PI)
+	{ 1.055502061411188,  0, 0, { -1,  12, -30, 20 } },	// sqrt(7/(2*PI))
+	{ 5.170882945826411, -1, 1, {  1,  -5,   5,  0 } },	// 2*sqrt(21/PI)
+	{ 8.175883811466258, -2, 0, {  0,   1,  -3,  2 } },	// sqrt(210/PI)
+	{ 6.675581178124546, -3, 3, {  1,   0,   0,  0 } }	// 2*sqrt(35/PI)
+};
+
+/*
+ * Fills 'weights' with the order*order HSH terms for the light direction (theta, phi).
+ * 'order' must be between 1 and HSH_MAX_ORDER.
+ */
+template <class T>
+inline void hsh_basis(double theta, double phi, int order, T * weights)
+{
+	double c[4], s[4], cos_m[HSH_MAX_ORDER], sin_m[HSH_MAX_ORDER];
+
+	c[0] = 1;
+	c[1] = cos(theta);
+	c[2] = c[1]*c[1];
+	c[3] = c[2]*c[1];
+
+	double c_c2 = c[1] - c[2];
+	s[0] = 1;
+	s[1] = (c_c2 > 0) ? sqrt(c_c2) : 0;
+	s[2] = s[1]*s[1];
+	s[3] = s[2]*s[1];
+
+	for (int m=0; m<HSH_MAX_ORDER; m++)
+	{
+		cos_m[m] = cos(m*phi);
+		sin_m[m] = sin(m*phi);
+	}
+
+	int terms = order*order;
+	for (int t=0; t<terms; t++)
+	{
+		const HshTerm & term = hsh_terms_table[t];
+		double polynomial = term.poly[0] + term.poly[1]*c[1] + term.poly[2]*c[2] + term.poly[3]*c[3];
+		double azimuth = (term.m > 0) ? cos_m[term.m] : ((term.m < 0) ? sin_m[-term.m] : 1);
+		weights[t] = (T)(term.norm * azimuth * s[term.power] * polynomial);
+	}
+}
+
+#endif	/* _HSH_BASIS_H */
@@ -0,0 +1,187 @@
+/*  HSHFitter
+ *  Copyright (C) 2009-11 UC Santa Cruz and Cultural Heritage Imaging
+ *    
+ *  Portions Copyright (C) 2010-11 Univ. do Minho and Cultural Heritage Imaging
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 3 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <fstream>
+#if _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+#include "hsh_cache.h"
+
+HshBasisCache::HshBasisCache()
+{
+	hits = misses = 0;
+	omp_init_lock(&lock);
+}
+
+HshBasisCache::~HshBasisCache()
+{
+	omp_destroy_lock(&lock);
+}
+
+/**
+ * 64 bit FNV-1a hash of the order and of the bit patterns of the light directions.
+ */
+unsigned long long HshBasisCache::key(const vector<double> & directions, int order)
+{
+	unsigned long long hash = 14695981039346656037ULL;
+	const unsigned char * bytes = (const unsigned char *)&order;
+	for (size_t i=0; i<sizeof(order); i++)
+		hash = (hash ^ bytes[i]) * 1099511628211ULL;
+	if (!directions.empty())
+	{
+		bytes = (const unsigned char *)&directions[0];
+		for (size_t i=0; i<directions.size()*sizeof(double); i++)
+			hash = (hash ^ bytes[i]) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+bool HshBasisCache::find(const vector<double> & directions, int order, vector<float> & basis, vector<float> & factor)
+{
+	unsigned long long k = key(directions, order);
+	bool found = false;
+	
+	omp_set_lock(&lock);
+	pair<multimap<unsigned long long, Entry>::iterator, multimap<unsigned long long, Entry>::iterator> range = entries.equal_range(k);
+	for (multimap<unsigned long long, Entry>::iterator it = range.first; it != range.second; it++)
+	{
+		if (it->second.order == order && it->second.directions == directions)
+		{
+			basis = it->second.basis;
+			factor = it->second.factor;
+			found = true;
+			break;
+		}
+	}
+	if (found)
+		hits++;
+	else
+		misses++;
+	omp_unset_lock(&lock);
+	
+	return found;
+}
+
+void HshBasisCache::insert(const vector<double> & directions, int order, const float * basis, const float * factor)
+{
+	int terms = order*order;
+	int lights = (int)directions.size()/3;
+	
+	Entry entry;
+	entry.directions = directions;
+	entry.order = order;
+	entry.basis.assign(basis, basis + terms*lights);
+	entry.factor.assign(factor, factor + terms*terms);
+	
+	unsigned long long k = key(directions, order);
+	
+	omp_set_lock(&lock);
+	// two concurrent fits of the same dome may both miss, keep the first one
+	pair<multimap<unsigned long long, Entry>::iterator, multimap<unsigned long long, Entry>::iterator> range = entries.equal_range(k);
+	bool present = false;
+	for (multimap<unsigned long long, Entry>::iterator it = range.first; it != range.second; it++)
+		if (it->second.order == order && it->second.directions == directions)
+			present = true;
+	if (!present)
+		entries.insert(make_pair(k, entry));
+	omp_unset_lock(&lock);
+}
+
+string HshBasisCache::filename(const string & directory, const vector<double> & directions, int order)
+{
+	char name[64];
+	sprintf(name, "hshbasis_%016llx.dat", key(directions, order));
+	if (directory.empty())
+		return name;
+	char last = directory[directory.size()-1];
+	if (last == '/' || last == '\\')
+		return directory + name;
+	return directory + "/" + name;
+}
+
+bool HshBasisCache::load(const string & directory, const vector<double> & directions, int order,
+						 vector<float> & basis, vector<float> & factor)
+{
+	ifstream file(filename(directory, directions, order).c_str(), ios::binary);
+	if (!file)
+		return false;
+	
+	char magic[8];
+	int version, file_order, lights;
+	file.read(magic, 8);
+	file.read((char *)&version, sizeof(int));
+	file.read((char *)&file_order, sizeof(int));
+	file.read((char *)&lights, sizeof(int));
+	if (!file || memcmp(magic, HSH_CACHE_MAGIC, 8) || version != HSH_CACHE_VERSION
+		|| file_order != order || lights != (int)directions.size()/3)
+		return false;
+	
+	vector<double> file_directions(directions.size());
+	if (!file_directions.empty())
+		file.read((char *)&file_directions[0], sizeof(double)*file_directions.size());
+	if (!file || file_directions != directions)
+		return false;
+	
+	int terms = order*order;
+	basis.resize(terms*lights);
+	factor.resize(terms*terms);
+	file.read((char *)&basis[0], sizeof(float)*basis.size());
+	file.read((char *)&factor[0], sizeof(float)*factor.size());
+	return (bool)file;
+}
+
+/**
+ * Writes to a temporary file first and renames it, so concurrent fits never read half an entry.
+ */
+bool HshBasisCache::save(const string & directory, const vector<double> & directions, int order,
+						 const float * basis, const float * factor)
+{
+	string final_name = filename(directory, directions, order);
+	char suffix[64];
+	sprintf(suffix, ".%d.%d.tmp", (int)getpid(), omp_get_thread_num());
+	string temporary_name = final_name + suffix;
+	
+	int terms = order*order;
+	int lights = (int)directions.size()/3;
+	int version = HSH_CACHE_VERSION;
+	
+	ofstream file(temporary_name.c_str(), ios::binary);
+	if (!file)
+		return false;
+	file.write(HSH_CACHE_MAGIC, 8);
+	file.write((const char *)&version, sizeof(int));
+	file.write((const char *)&order, sizeof(int));
+	file.write((const char *)&lights, sizeof(int));
+	if (!directions.empty())
+		file.write((const char *)&directions[0], sizeof(double)*directions.size());
+	file.write((const char *)basis, sizeof(float)*terms*lights);
+	file.write((const char *)factor, sizeof(float)*terms*terms);
+	file.close();
+	
+	if (!file || rename(temporary_name.c_str(), final_name.c_str()))
+	{
+		remove(temporary_name.c_str()); // another fit saved it first on systems that refuse to replace a file
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,80 @@
+/*  HSHFitter
+ *  Copyright (C) 2009-11 UC Santa Cruz and Cultural Heritage Imaging
+ *    
+ *  Portions Copyright (C) 2010-11 Univ. do Minho and Cultural Heritage Imaging
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 3 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _HSH_CACHE_H
+#define	_HSH_CACHE_H
+
+#include <map>
+#include <vector>
+#include <string>
+#include <omp.h>
+
+using namespace std;
+
+/**
+ * Basis matrices shared by the fits of a batch. The HSH matrix and the factored normal
+ * matrix only depend on the order and on the light directions, so captures taken with
+ * the same dome compute them once. Entries are keyed by a hash of the order and the
+ * directions, the directions are kept to rule out collisions. Safe to use from concurrent fits.
+ * load and save keep the same entries in a directory, so later runs with the same dome reuse them.
+ */
+class HshBasisCache {
+public:
+	HshBasisCache();
+	~HshBasisCache();
+
+	/**
+	 * Copies the [terms][lights] basis and the [terms][terms] Cholesky factor of its normal
+	 * matrix for 'directions' (x, y, z per light) and 'order'. Returns false if they are not cached.
+	 */
+	bool find(const vector<double> & directions, int order, vector<float> & basis, vector<float> & factor);
+	void insert(const vector<double> & directions, int order, const float * basis, const float * factor);
+
+	static unsigned long long key(const vector<double> & directions, int order);
+
+	/**
+	 * Reads or writes the entry of 'directions' and 'order' in 'directory', one file per
+	 * entry named after its key. The files are in the byte order of the machine, an entry
+	 * that does not match exactly is ignored.
+	 */
+	static bool load(const string & directory, const vector<double> & directions, int order,
+					 vector<float> & basis, vector<float> & factor);
+	static bool save(const string & directory, const vector<double> & directions, int order,
+					 const float * basis, const float * factor);
+	static string filename(const string & directory, const vector<double> & directions, int order);
+
+	int hits, misses;
+
+private:
+	struct Entry {
+		vector<double> directions;
+		int order;
+		vector<float> basis, factor;
+	};
+
+	multimap<unsigned long long, Entry> entries;
+	omp_lock_t lock;
+};
+
+// header of the cache files, followed by the order and the number of lights (ints), the directions
+// (doubles), the basis and the factor (floats)
+#define HSH_CACHE_MAGIC "HSHBASIS"
+#define HSH_CACHE_VERSION 1
+
+#endif	/* _HSH_CACHE_H */
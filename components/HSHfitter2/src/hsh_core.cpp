@@ -27,8 +27,10 @@ extern "C" {
 	 */
 	//     TransA,TransB,M, N    ,K  , ALPH , A    , lda,B  , ldb   ,beta  ,C     ,ldc
 	void sgemm_(char*,char*,int*,int*,int*,float*,float*,int*,float*,int*,float*,float*,int*);
-	//          N   ,NRHS,  A,   LDA, IPIV,  B,   LDB,INFO)
-	void sgesv_(int*,int*,float*,int*,int*,float*,int*,int*);
+	//           UPLO, N  , A    , LDA, INFO)
+	void spotrf_(char*,int*,float*,int*,int*);
+	//          SIDE ,UPLO ,TransA,DIAG , M  , N  , ALPHA, A    , LDA, B    , LDB)
+	void strsm_(char*,char*,char*,char*,int*,int*,float*,float*,int*,float*,int*);
 }
 
 #else
@@ -37,27 +39,79 @@ extern "C" {
 
 
 #include <stdlib.h> //malloc use
+#if _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <unistd.h>
+#include <sys/resource.h>
+#endif
+#include <sys/stat.h>
 #include "hsh_core.hpp"
+#include "hsh_basis.h"
 #include <math.h>
 #include <float.h>
+#include <algorithm>
 
 typedef unsigned char uchar;
 
 using namespace std;
 
-HshCore::HshCore(Input * data){
+const char * hsh_stage_names[STAGE_COUNT] = { "decode", "sgemm", "solve", "robust", "quantize", "write", "tiles" };
+
+HshCore::HshCore(Input * data, HshBasisCache * basis_cache){
 	in = data;
+	this->basis_cache = basis_cache;
+	output = &cout;
+	for (int s=0; s<STAGE_COUNT; s++)
+		stage_time[s] = 0;
+	total_time = 0;
+	bytes_read = bytes_written = spill_bytes = peak_rss = 0;
+	rectifier = NULL;
+	rect_window = NULL;
+}
+
+/**
+ * Adds the time elapsed since 'started' to 'stage' and returns the current time,
+ * so consecutive stages can be timed with a single clock read between them.
+ */
+double HshCore::lap(HshStage stage, double started)
+{
+	double now = omp_get_wtime();
+	stage_time[stage] += now - started;
+	return now;
+}
+
+/**
+ * Prints a progress line if at least in->progress_interval seconds passed since the last one
+ * ('done' out of 'total' rows or images). Always prints when 'done' reaches 'total'.
+ */
+void HshCore::report_progress(int done, int total, const char * unit)
+{
+	if (in->progress_interval <= 0)
+		return;
+	
+	double now = omp_get_wtime();
+	if (now - last_progress < in->progress_interval && done < total)
+		return;
+	last_progress = now;
+	
+	double elapsed = now - progress_started;
+	double rate = (elapsed > 0) ? done/elapsed : 0;
+	*output << "Progress : " << done << "/" << total << " " << unit << " (" << (int)(100.0*done/total) << "%), "
+		 << rate << " " << unit << "/s, " << ((rate > 0) ? (total-done)/rate : 0) << " s left" << endl;
 }
 
 void HshCore::find_min_max(float * matrix, int row, float& min, float&max)
 {
 	//int height = in->order*in->order;
-	int width = in->width*in->height*in->channels;
+	size_t width = (size_t)in->width*in->height*in->channels;
 	//float* data_ptr = matrix->data.fl+(width*row);
 	float * data_ptr = &(matrix[width*row]);
 	min = FLT_MAX;
 	max = -FLT_MAX;
-	for (int i=0;i<width;i++)
+	for (size_t i=0;i<width;i++)
 	{
 		float current = (*data_ptr);
 		if (current<min) min = current;
@@ -74,8 +128,9 @@ void HshCore::make_hsh_matrix()
 	hsh_matrix = (float *)malloc(sizeof(float) * terms * in->num_used);
 	
 	
-	cout << "HSH matrix : Rows= " << terms << " Columns=" << in->num_used << endl;
+	*output << "HSH matrix : Rows= " << terms << " Columns=" << in->num_used << endl;
 	
+	float weights[HSH_MAX_TERMS];
 	for (int i=0; i < in->num_used; i++)
 	{
 		double& lx = in->lit_images[i].lx;
@@ -85,99 +140,247 @@ void HshCore::make_hsh_matrix()
 		if (phi<0) phi = 2*M_PI+phi;
 		double theta = acos(lz);
 		
-		// depending on the specified order of HSH, fill in the number of terms
-		// based on lx, ly and lz
-		//*num_used+i
-		hsh_matrix[i] = 1/sqrt(2*M_PI);
-		
-		hsh_matrix[in->num_used+i] = sqrt(6/M_PI)      *  (cos(phi)*sqrt(cos(theta)-cos(theta)*cos(theta)));
-		
-		hsh_matrix[2*in->num_used+i] = sqrt(3/(2*M_PI)) *  (-1 + 2*cos(theta));
-		
-		hsh_matrix[3*in->num_used+i] = sqrt(6/M_PI)      *  (sqrt(cos(theta) - pow(cos(theta),2))*sin(phi));
-		
-		if(in->order>2)
-		{
-			hsh_matrix[4*in->num_used+i] = sqrt(30/M_PI)     *  (cos(2*phi)*(-cos(theta) + pow(cos(theta),2)));
-			
-			hsh_matrix[5*in->num_used+i] = sqrt(30/M_PI)     *  (cos(phi)*(-1 + 2*cos(theta))*sqrt(cos(theta) - pow(cos(theta),2)));
-			
-			hsh_matrix[6*in->num_used+i] = sqrt(5/(2*M_PI)) *  (1 - 6*cos(theta) + 6*pow(cos(theta),2));
-			
-			hsh_matrix[7*in->num_used+i] = sqrt(30/M_PI)     *  ((-1 + 2*cos(theta))*sqrt(cos(theta) - pow(cos(theta),2))*sin(phi));
-			
-			hsh_matrix[8*in->num_used+i] = sqrt(30/M_PI)     *  ((-cos(theta) + pow(cos(theta),2))*sin(2*phi));
-		}
-		
-		if(in->order>3)
+		// fill in the terms of the specified order based on lx, ly and lz
+		hsh_basis(theta, phi, in->order, weights);
+		for (int t=0; t<terms; t++)
+			hsh_matrix[t*in->num_used+i] = weights[t];
+	}
+	
+}
+
+/**
+ * Builds the basis (hsh_matrix) and the Cholesky factor of its normal matrix (mat_float_a),
+ * or copies them from the basis cache when another fit already used the same lights and order,
+ * or from the cache directory when a previous run did. New ones are saved to the cache directory.
+ * Both are allocated even on failure. Returns false if the normal matrix is singular.
+ */
+bool HshCore::prepare_basis()
+{
+	int terms = in->order*in->order;
+	
+	mat_float_a = (float*)malloc(sizeof(float)*terms*terms);
+	
+	vector<double> directions(3*in->num_used);
+	for (int i=0; i<in->num_used; i++)
+	{
+		directions[3*i] = in->lit_images[i].lx;
+		directions[3*i+1] = in->lit_images[i].ly;
+		directions[3*i+2] = in->lit_images[i].lz;
+	}
+	
+	vector<float> basis, factor;
+	bool cached = basis_cache && basis_cache->find(directions, in->order, basis, factor);
+	if (cached)
+		*output << "HSH matrix : reusing the basis of a previous fit with the same lights" << endl;
+	else if (!in->str_basis_cache_dir.empty()
+			 && HshBasisCache::load(in->str_basis_cache_dir, directions, in->order, basis, factor))
+	{
+		*output << "HSH matrix : loaded " << HshBasisCache::filename(in->str_basis_cache_dir, directions, in->order) << endl;
+		if (basis_cache)
+			basis_cache->insert(directions, in->order, &basis[0], &factor[0]);
+		cached = true;
+	}
+	
+	if (cached)
+	{
+		hsh_matrix = (float *)malloc(sizeof(float) * terms * in->num_used);
+		memcpy(hsh_matrix, &basis[0], sizeof(float) * terms * in->num_used);
+		memcpy(mat_float_a, &factor[0], sizeof(float) * terms * terms);
+		return true;
+	}
+	
+	make_hsh_matrix();
+	
+	/**
+	 * A^T*A is the same for every pixel, factor it once and only back-substitute per block
+	 */
+	if (!factor_normal_matrix(hsh_matrix, mat_float_a, terms))
+		return false;
+	
+	if (basis_cache)
+		basis_cache->insert(directions, in->order, hsh_matrix, mat_float_a);
+	
+	if (!in->str_basis_cache_dir.empty()
+		&& !HshBasisCache::save(in->str_basis_cache_dir, directions, in->order, hsh_matrix, mat_float_a))
+		*output << "Unable to save the HSH matrix to " << HshBasisCache::filename(in->str_basis_cache_dir, directions, in->order) << endl;
+	
+	return true;
+}
+
+/**
+ * Builds the PTM basis, (lu, lv) being the x and y of the light direction as in the viewer,
+ * and factors its normal matrix. Both are allocated even on failure.
+ * Returns false if the normal matrix is singular.
+ */
+bool HshCore::prepare_ptm_basis()
+{
+	ptm_matrix = (float *)malloc(sizeof(float) * PTM_TERMS * in->num_used);
+	ptm_factor = (float *)malloc(sizeof(float) * PTM_TERMS * PTM_TERMS);
+	
+	*output << "PTM matrix : Rows= " << PTM_TERMS << " Columns=" << in->num_used << endl;
+	
+	for (int t=0; t<PTM_TERMS; t++)
+		ptm_sums[t] = 0;
+	for (int i=0; i<in->num_used; i++)
+	{
+		float lu = (float)in->lit_images[i].lx;
+		float lv = (float)in->lit_images[i].ly;
+		float weights[PTM_TERMS] = { lu*lu, lv*lv, lu*lv, lu, lv, 1 };
+		for (int t=0; t<PTM_TERMS; t++)
 		{
-			hsh_matrix[9*in->num_used+i] = 2*sqrt(35/M_PI)  * cos(3*phi)*pow((cos(theta) - pow(cos(theta),2)),(3/2));
-			
-			hsh_matrix[10*in->num_used+i] = (sqrt(210/M_PI)  * cos(2*phi)*(-1 + 2*cos(theta))*(-cos(theta) + pow(cos(theta),2)));
-			
-			hsh_matrix[11*in->num_used+i] = 2*sqrt(21/M_PI)  * cos(phi)*sqrt(cos(theta) - pow(cos(theta),2))*(1 - 5*cos(theta) + 5*pow(cos(theta),2));
-			
-			hsh_matrix[12*in->num_used+i] = sqrt(7/(2*M_PI)) * (-1 + 12*cos(theta) - 30*pow(cos(theta),2) + 20*pow(cos(theta),3));
-			
-			hsh_matrix[13*in->num_used+i] = 2*sqrt(21/M_PI)  * sqrt(cos(theta) - pow(cos(theta),2))*(1 - 5*cos(theta) + 5*pow(cos(theta),2))*sin(phi);
-			
-			hsh_matrix[14*in->num_used+i] = (sqrt(210/M_PI)  * (-1 + 2*cos(theta))*(-cos(theta) + pow(cos(theta),2))*sin(2*phi));
-			
-			hsh_matrix[15*in->num_used+i] = 2*sqrt(35/M_PI)  * pow((cos(theta) - pow(cos(theta),2)),(3/2))*sin(3*phi);
+			ptm_matrix[t*in->num_used+i] = weights[t];
+			ptm_sums[t] += weights[t];
 		}
 	}
 	
+	return factor_normal_matrix(ptm_matrix, ptm_factor, PTM_TERMS);
 }
 
-void HshCore::stack_all_images2(){
+/**
+ * Decodes every lit image straight into its [channels][height*width] slice of mat_float.
+ * The images are independent, so they are decoded in parallel and each decoder
+ * is released as soon as its image is done. Returns false if an image could not be read,
+ * its slice is then left undefined.
+ */
+bool HshCore::stack_all_images2(){
 	
-	int size = in->height*in->width*in->channels;
+	size_t size = (size_t)in->height*in->width*in->channels;
+	int decoded = 0;
+	bool read = true;
 	
+#pragma omp parallel for schedule(dynamic) num_threads(in->numberOfThreads)
 	for (int i=0; i<in->num_used; i++)
 	{
-		Image * image = new Image(in->lit_images[i].filename,0);
-		
-		image->LoadImage();
+		LitImage & lit = in->lit_images[i];
+		Image * image = in->open_image(lit.filename);
+		if (image)
+			image->SetScales(lit.scale_r, lit.scale_g, lit.scale_b);
 		
-		for(int j=0; j<in->height*in->width*in->channels;j++){
-			mat_float[i*size+j] = image->dataFloat[j];
-			
+		if (!image || !image->LoadImage(&(mat_float[i*size]), true))
+		{
+#pragma omp critical
+			{
+				*output << "Error reading image " << in->lit_images[i].filename << endl;
+				read = false;
+			}
 		}
 		
+		delete image;
+		
+#pragma omp critical
+		report_progress(++decoded, in->num_used, "images");
 	}
 	
+	return read;
 }
 
-void HshCore::stack_all_rows()
+/**
+ * Reads the next 'rows' scanlines of every lit image into 'staging',
+ * one [channels][rows*width] slice per image. Every image has its own
+ * reader, which decodes straight into the staging planes, so the images are decoded in parallel.
+ * Returns false if a reader failed, the block is then left incomplete.
+ */
+bool HshCore::stack_all_rows(float * staging, int rows)
 {
-	int size = in->width*in->channels;
+	size_t plane = (size_t)in->width*rows;
+	size_t image = plane*in->channels;
+	bool read = true;
 	
+	if (rectifier)
+		return stack_rectified_rows(staging, rows);
+	
+#pragma omp parallel for schedule(dynamic) num_threads(in->numberOfThreads)
 	for (int i=0; i<in->num_used; i++)
 	{
-		for (int j=0; j<in->height; j++)
+		for (int j=0; j<rows; j++)
 		{
-			if(in->lit_images[i].img->LoadImageRowByRow()){
-				for(int k = 0;k < in->width*in->channels;k++){
-					mat_float[i*size+k] =in->lit_images[i].img->rowData[k];
+			if (!in->lit_images[i].img->LoadImageRowByRow(&(staging[i*image+j*in->width]), plane))
+			{
+#pragma omp critical
+				{
+					*output << "Error reading image " << in->lit_images[i].filename << endl;
+					read = false;
 				}
-				
+				break;
 			}
-			
 		}
 	}
+	return read;
+}
+
+/**
+ * stack_all_rows with the axis rectification : the reader of every image decodes the
+ * source rows the next block needs into its window, then the block is warped from the window into 'staging'.
+ */
+bool HshCore::stack_rectified_rows(float * staging, int rows)
+{
+	size_t plane = (size_t)in->width*rows;
+	size_t image = plane*in->channels;
+	size_t window_plane = (size_t)in->width*rect_window_rows;
+	int first_row = rect_block*in->height;
+	int last_source = rectifier->last_source_row(rect_block++);
+	bool read = true;
+	
+#pragma omp parallel for schedule(dynamic) num_threads(in->numberOfThreads)
+	for (int i=0; i<in->num_used; i++)
+	{
+		float * window = &(rect_window[i*window_plane*in->channels]);
+		bool image_read = true;
+		for (int r=rect_rows_read; r<=last_source && image_read; r++)
+			image_read = in->lit_images[i].img->LoadImageRowByRow(&(window[(r % rect_window_rows)*in->width]), window_plane);
+		if (!image_read)
+		{
+#pragma omp critical
+			{
+				*output << "Error reading image " << in->lit_images[i].filename << endl;
+				read = false;
+			}
+			continue;
+		}
+		for (int c=0; c<in->channels; c++)
+			rectifier->warp(&(window[c*window_plane]), rect_window_rows, &(staging[i*image+c*plane]), first_row, rows);
+	}
+	rect_rows_read = max(rect_rows_read, last_source+1);
+	return read;
+}
+
+/**
+ * Axis rectification of the all in memory fit : every plane of mat_float is
+ * copied aside and warped back in place, in parallel over its rows.
+ */
+void HshCore::rectify_all_images()
+{
+	size_t plane = (size_t)in->width*in->height;
+	float * source = (float *)malloc(sizeof(float) * plane);
 	
-	//return matrix;
+	for (int p=0; p<in->num_used*in->channels; p++)
+	{
+		float * dest = &(mat_float[p*plane]);
+		memcpy(source, dest, sizeof(float) * plane);
+#pragma omp parallel for schedule(dynamic, 16) num_threads(in->numberOfThreads)
+		for (int y=0; y<in->height; y++)
+			rectifier->warp(source, in->height, &(dest[(size_t)y*in->width]), y, 1);
+	}
+	free(source);
 }
 
-void HshCore::prepareRowByRow(){
+bool HshCore::prepareRowByRow(){
 	
 	//cout << "PrepareRowByRow" << endl;
 	
 	for(int i = 0; i < in->num_used ; i++){
-		in->lit_images[i].img = new Image(in->lit_images[i].filename,0);
-		in->lit_images[i].img->PrepareRowByRow();
+		LitImage & lit = in->lit_images[i];
+		lit.img = in->open_image(lit.filename);
+		if (lit.img)
+			lit.img->SetScales(lit.scale_r, lit.scale_g, lit.scale_b);
+		if (!lit.img || !lit.img->PrepareRowByRow())
+		{
+			*output << "Error reading image " << in->lit_images[i].filename << endl;
+			return false;
+		}
 		//cout << "Image : " << i << "Ready" << endl;
 	}
+	return true;
 }
 
 void HshCore::destroyRowByRow(){
@@ -185,143 +388,202 @@ void HshCore::destroyRowByRow(){
 	//cout << "DestroyRowByRow" << endl;
 	
 	for(int i = 0; i < in->num_used ; i++){
+		if (!in->lit_images[i].img) continue;
 		in->lit_images[i].img->DestroyRowByRow();
+		delete in->lit_images[i].img;
+		in->lit_images[i].img = NULL;
 		//cout << "Image : " << i << "Destroyed" << endl;
 	}
 }
 
 
-bool HshCore::convert_hsh_raw_to_compressed(const char *in_filename, const char * out_filename)
+/**
+ * Row-by-row compressed saving : the (min, max) of each term over the whole image is only
+ * known once every block is fitted. Each block is therefore kept in the 'spill' file as 16 bit
+ * values relative to its own per-term (min, max), and hsh_save_spilled requantizes
+ * them to the final 8 bit values once the fit is done.
+ */
+bool HshCore::hsh_spill_block(FILE * spill, float *hsh_matrix, int rows)
 {
-	int height, width, channels; //, order;
-	float tmpf[30];
-	unsigned char tmpuc[30];
-	char buffer[500];
-	
-	
-	ofstream savefile(out_filename,ios::binary);
-	
-	ifstream infile(in_filename,ios::binary);
-	
-	infile.getline(buffer,500);
-	
-	int file_type, terms, basis_type, element_size;
-	float dummy_scale, dummy_bias;
-	infile >> file_type;
-	infile >> width >> height >> channels;
-	infile >> terms >> basis_type >> element_size;
-	infile.getline(buffer,10);
-	
-	for (int i=0; i<terms; i++)
-		infile.read((char *)&dummy_scale,sizeof(float)); // scale
-	for (int i=0; i<terms; i++)
-		infile.read((char *)&dummy_bias,sizeof(float)); // scale
-	
-	
-	
-	//write header
-	savefile << "#HSH1.2\r\n";
-	
-	savefile << 3 << "\r\n"; // basis_type HSH
-	savefile << width << " " << height << " " << channels << "\r\n";
-	savefile << terms << " " << 2 << " " << 1 << "\r\n"; // basis_terms, basis_type == RGB seperate, element_size = 1 byte
+	int terms = in->order*in->order;
+	size_t M_PIxels = (size_t)in->width*rows*in->channels;
+	double started = omp_get_wtime();
 	
-	//write scaling values for each term
-	for (int i=0; i<terms; i++)
+	vector<float> block_min(terms), block_max(terms);
+	for (int t=0; t<terms; t++)
 	{
-		float diff = max_term[i]-min_term[i];
-		savefile.write((char *)&diff,sizeof(float)); // scale
+		float * float_ptr = &(hsh_matrix[M_PIxels*t]);
+		block_min[t] = FLT_MAX;
+		block_max[t] = -FLT_MAX;
+		for (size_t i=0; i<M_PIxels; i++)
+		{
+			if (float_ptr[i]<block_min[t]) block_min[t] = float_ptr[i];
+			if (float_ptr[i]>block_max[t]) block_max[t] = float_ptr[i];
+		}
+		if (block_min[t]<min_term[t]) min_term[t] = block_min[t];
+		if (block_max[t]>max_term[t]) max_term[t] = block_max[t];
 	}
-	for (int i=0; i<terms; i++)
-		savefile.write((char *)&min_term[i],sizeof(float)); // bias
-	
 	
-	for (int i=0; i<height; i++)
-		for (int j=0; j<width; j++)
-			for (int c=0; c<channels; c++)
+	// the channel planes of every term are interleaved back to [pixel][channel][term]
+	size_t plane = M_PIxels/in->channels;
+	size_t stride = (size_t)in->channels*terms;
+	spill_buffer.resize(M_PIxels*terms);
+	for (int t=0; t<terms; t++)
+	{
+		float diff = block_max[t]-block_min[t];
+		float scale = (diff > 0) ? 65535/diff : 0;
+		for (int c=0; c<in->channels; c++)
+		{
+			float * float_ptr = &(hsh_matrix[M_PIxels*t+plane*c]);
+			unsigned short * spill_ptr = &(spill_buffer[c*terms+t]);
+			for (size_t i=0; i<plane; i++)
 			{
-				infile.read((char *)&tmpf,sizeof(float)*terms);
-				for (int t=0; t<terms; t++)
-				{
-					float value = tmpf[t];
-					value = ((value-min_term[t])/(max_term[t]-min_term[t]))*255;
-					tmpuc[t] = value;
-				}
-				savefile.write((char *)&tmpuc,sizeof(unsigned char)*terms);
+				*spill_ptr = (unsigned short)((float_ptr[i]-block_min[t])*scale + 0.5f);
+				spill_ptr += stride;
 			}
+		}
+	}
 	
-	infile.close();
-	savefile.close();
-	return true;
+	started = lap(STAGE_QUANTIZE, started);
+	
+	fwrite(&(block_min[0]), sizeof(float), terms, spill);
+	fwrite(&(block_max[0]), sizeof(float), terms, spill);
+	bool written = fwrite(&(spill_buffer[0]), sizeof(unsigned short), spill_buffer.size(), spill) == spill_buffer.size();
+	spill_bytes += 2*sizeof(float)*terms + sizeof(unsigned short)*spill_buffer.size();
+	lap(STAGE_WRITE, started);
+	return written;
 }
 
-
-bool HshCore::hsh_save(ofstream &savefile, float *hsh_matrix)
+/**
+ * Writes the final 8 bit HSH from the blocks stored by hsh_spill_block.
+ */
+bool HshCore::hsh_save_spilled(FILE * spill, ofstream &savefile)
 {
 	int terms = in->order*in->order;
-	int M_PIxels = in->width*in->height*in->channels;
 	
-	ifstream ift;
+	rewind(spill);
+	hsh_save_compressed_header(savefile, in->fullheight);
 	
-	cout << terms << " " << M_PIxels << " ";
-	for (int i=0; i<terms; i++)
+	vector<float> block_min(terms), block_max(terms), a(terms), b(terms);
+	vector<uchar> out_buffer;
+	
+	for (int row=0; row<in->fullheight; row+=in->height)
 	{
-		find_min_max(hsh_matrix,i,min_term[i],max_term[i]);
+		size_t M_PIxels = (size_t)in->width*min(in->height, in->fullheight-row)*in->channels;
+		double started = omp_get_wtime();
 		
-		//float * float_ptr = hsh_matrix->data.fl + M_PIxels*i;
-		float * float_ptr = &(hsh_matrix[M_PIxels*i]);
-		//uchar* char_ptr = hsh_matrix->data.ptr + hsh_matrix->step*i;
-		float diff = max_term[i]-min_term[i];
+		if (fread(&(block_min[0]), sizeof(float), terms, spill) != (size_t)terms ||
+			fread(&(block_max[0]), sizeof(float), terms, spill) != (size_t)terms)
+			return false;
+		
+		spill_buffer.resize(M_PIxels*terms);
+		if (fread(&(spill_buffer[0]), sizeof(unsigned short), spill_buffer.size(), spill) != spill_buffer.size())
+			return false;
+		
+		// 8 bit value = ((block_min + q*block_diff/65535) - min)/diff*255 = q*a + b
+		for (int t=0; t<terms; t++)
+		{
+			float diff = max_term[t]-min_term[t];
+			float scale = (diff > 0) ? 255/diff : 0;
+			a[t] = (block_max[t]-block_min[t])/65535*scale;
+			b[t] = (block_min[t]-min_term[t])*scale;
+		}
 		
-		//this loop goes from the first to the last M_PIxel in an image, it's in row-by-row order
-		for (int j=0; j<M_PIxels; j++)
+		out_buffer.resize(spill_buffer.size());
+		for (size_t i=0; i<M_PIxels; i++)
 		{
-			float value = (*float_ptr);
-			value = ((value-min_term[i])/diff)*255;
-			(*float_ptr) = value;
-			float_ptr++;
+			for (int t=0; t<terms; t++)
+			{
+				float value = spill_buffer[i*terms+t]*a[t] + b[t];
+				if (value < 0) value = 0;
+				if (value > 255) value = 255;
+				out_buffer[i*terms+t] = (uchar)value;
+			}
 		}
+		started = lap(STAGE_QUANTIZE, started);
+		savefile.write((char *)&(out_buffer[0]), out_buffer.size());
+		lap(STAGE_WRITE, started);
 	}
+	
+	return true;
+}
+
+/**
+ * Writes the 8 bit HSH header, the scale and bias of each term come from (min_term, max_term).
+ */
+void HshCore::hsh_save_compressed_header(ofstream &savefile, int height)
+{
+	int terms = in->order*in->order;
+	
 	savefile << "#HSH1.2\r\n";
 	
 	savefile << 3 << "\r\n"; // basis_type HSH
-	savefile << in->width << " " << in->height << " " << in->channels << "\r\n";
+	savefile << in->width << " " << height << " " << in->channels << "\r\n";
 	savefile << terms << " " << 2 << " " << 1 << "\r\n"; // basis_terms, basis_type == RGB seperate, element_size = 1 byte
 	
 	
-	cout << endl;
+	*output << endl;
 	//write scaling values for each term
 	for (int i=0; i<terms; i++)
 	{
 		float diff = max_term[i]-min_term[i];
-		cout <<  diff << " , " ;
+		*output <<  diff << " , " ;
 		savefile.write((char *)&diff,sizeof(float)); // scale
 	}
 	
-	cout << endl << endl;
+	*output << endl << endl;
 	for (int i=0; i<terms; i++)
 	{
-		cout << min_term[i] << " , " ;
+		*output << min_term[i] << " , " ;
 		savefile.write((char *)&min_term[i],sizeof(float)); // bias
 	}
-	cout << endl;
+	*output << endl;
+}
+
+
+bool HshCore::hsh_save(ofstream &savefile, float *hsh_matrix)
+{
+	int terms = in->order*in->order;
+	size_t M_PIxels = (size_t)in->width*in->height*in->channels;
+	
+	*output << terms << " " << M_PIxels << " ";
+	double started = omp_get_wtime();
+	for (int i=0; i<terms; i++)
+		find_min_max(hsh_matrix,i,min_term[i],max_term[i]);
+	lap(STAGE_QUANTIZE, started);
 	
+	hsh_save_compressed_header(savefile, in->height);
+	
+	vector<float> scale(terms);
 	for (int t=0; t<terms; t++)
 	{
-		//term_ptr[t] = hsh_matrix->data.fl + M_PIxels*t;
-		term_ptr[t] = &(hsh_matrix[M_PIxels*t]);
+		float diff = max_term[t]-min_term[t];
+		scale[t] = (diff > 0) ? 255/diff : 0;
 	}
 	
-	//write the raw data
-	//this loop goes from the first to the last M_PIxel in an image, its in row-by-row order
-	for (int i=0; i<M_PIxels; i++)
+	//write the raw data, pixel-interleaved : the channel planes of the terms are transposed and
+	//quantized one cache sized block of pixels at a time and written with a single call per block
+	size_t plane = M_PIxels/in->channels;
+	size_t stride = (size_t)in->channels*terms;
+	vector<uchar> out_buffer(SAVE_BLOCK_PIXELS*stride);
+	for (size_t first=0; first<plane; first+=SAVE_BLOCK_PIXELS)
 	{
+		double started = omp_get_wtime();
+		size_t count = min((size_t)SAVE_BLOCK_PIXELS, plane-first);
 		for (int t=0; t<terms; t++)
 		{
-			uchar char_value = (*term_ptr[t]);
-			savefile.write((char*)&char_value,1);
-			term_ptr[t]++;
+			const float bias = min_term[t], s = scale[t];
+			for (int c=0; c<in->channels; c++)
+			{
+				const float * float_ptr = &(hsh_matrix[M_PIxels*t+plane*c+first]);
+				uchar * char_ptr = &(out_buffer[c*terms+t]);
+				for (size_t i=0; i<count; i++)
+					char_ptr[i*stride] = (uchar)((float_ptr[i]-bias)*s);
+			}
 		}
+		started = lap(STAGE_QUANTIZE, started);
+		savefile.write((char *)&(out_buffer[0]), count*stride);
+		lap(STAGE_WRITE, started);
 	}
 	
 	return true;
@@ -345,259 +607,1055 @@ void HshCore::hsh_save_uncompressed_header(ofstream &savefile)
 		savefile.write((char *)&bias,sizeof(float));
 }
 
-bool HshCore::hsh_save_uncompressed(ofstream &savefile, float *hsh_matrix)
+bool HshCore::hsh_save_uncompressed(ofstream &savefile, float *hsh_matrix, int rows)
 {
 	int terms = in->order*in->order;
-	int M_PIxels = in->width*in->height*in->channels;
-	
-	
-	for (int t=0; t<terms; t++)
-	{
-		//term_ptr[t] = hsh_matrix->data.fl + M_PIxels*t;
-		term_ptr[t] = &(hsh_matrix[M_PIxels*t]);
-	}
+	size_t M_PIxels = (size_t)in->width*rows*in->channels;
 	
-	//write the raw data
-	//this loop goes from the first to the last M_PIxel in an image, its in row-by-row order
-	for (int i=0; i<M_PIxels; i++)
+	//write the raw data, pixel-interleaved, transposing one block of pixels at a time
+	size_t plane = M_PIxels/in->channels;
+	size_t stride = (size_t)in->channels*terms;
+	vector<float> out_buffer(SAVE_BLOCK_PIXELS*stride);
+	for (size_t first=0; first<plane; first+=SAVE_BLOCK_PIXELS)
 	{
+		double started = omp_get_wtime();
+		size_t count = min((size_t)SAVE_BLOCK_PIXELS, plane-first);
 		for (int t=0; t<terms; t++)
 		{
-			savefile.write((char *)term_ptr[t],sizeof(float));
-			if (in->is_compressed) // compressed in row-by-row saving means we have to track min-max and do a second pass
+			for (int c=0; c<in->channels; c++)
 			{
-				float value = (*term_ptr[t]);
-				if (value<min_term[t]) min_term[t]=value;
-				if (value>max_term[t]) max_term[t]=value;
+				const float * float_ptr = &(hsh_matrix[M_PIxels*t+plane*c+first]);
+				float * out_ptr = &(out_buffer[c*terms+t]);
+				for (size_t i=0; i<count; i++)
+					out_ptr[i*stride] = float_ptr[i];
 			}
-			term_ptr[t]++;
 		}
+		started = lap(STAGE_QUANTIZE, started);
+		savefile.write((char *)&(out_buffer[0]), sizeof(float)*count*stride);
+		lap(STAGE_WRITE, started);
 	}
 	
-	return true;
-}
-
-
-void initializeMatrix(float * matrix,int width,int height){
-	for(int i = 0; i < height; i++){
-		for(int j=0; j < width; j++){
-			matrix[i*width+j] = 0.0;
-		}
-	}
+	return savefile.good();
 }
 
-void HshCore::delColumn(float * mat_float_b_column,int colunaI,int height,int width){
-	int k=0;
-	int j=colunaI;
-	for(int i = 0; i < height; i++){
-		mat_float_b_column[k] = mat_float_b[j];
-		++k;
-		j+=width;
-	}
-}
 
-void HshCore::addColumn(float * mat_float_b_column,int colunaI,int height,int width){
-	int k=0;
-	int j=colunaI;
-	for(int i = 0; i < height; i++){
-		mat_float_b_backup[j] = mat_float_b_column[k];
-		++k;
-		j+=width;
-		
-	}
+/**
+ * Moves the read position of a temporary file, beyond 2GB on every system.
+ */
+static bool seek_file(FILE * file, double offset)
+{
+#if _WIN32
+	return _fseeki64(file, (__int64)offset, SEEK_SET) == 0;
+#else
+	return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
 }
 
-void HshCore::compute_loop()
+/**
+ * Converts a block of PTM coefficients ([PTM_TERMS][channels][pixels], fitted to the normalized
+ * samples) to pixel units and appends it to 'store', the global bounds of the terms are only
+ * known once every block is fitted. RGB blocks hold a [pixels][PTM_TERMS] float section per
+ * channel, LRGB blocks a [pixels][PTM_TERMS] luminance section followed by [pixels][3] colors.
+ *
+ * The luminance polynomial is the mean of the channel polynomials, which is the least squares
+ * fit of the mean of the channels as the fit is linear. The color of a pixel is the sum of each
+ * channel over the lights, which is the sum of the predictions as the basis has a constant term,
+ * scaled so that the brightest channel is 255 and the luminance polynomial scaled to match.
+ */
+bool HshCore::ptm_store_block(FILE * store, float * result, int rows)
 {
+	int channels = in->channels;
+	int plane = in->width*rows;
+	size_t image = (size_t)plane*channels;
+	double started = omp_get_wtime();
 	
-	time_t start;
-	start = time(NULL);
-	ofstream outfile;
-	int terms = in->order*in->order;
-	
-	int width = in->width*in->channels;
-	
+	// samples are (v+1)/255 for an 8 bit value v, the offset is removed from the constant term
+	const float offset[PTM_TERMS] = { 0, 0, 0, 0, 0, 1 };
 	
-	if (in->is_row_by_row)
+	vector<float> coefficients;
+	vector<uchar> colors;
+	if (in->ptm_format == PTM_RGB)
 	{
-		if (in->is_compressed) // row-by-row and compressed, we'll save to a temporary file and then convert
-			outfile.open("temp.hsh",ios::binary);
-		else			// no temporary files, the uncompressed file is the output
-			outfile.open(in->str_output_filename.c_str(),ios::binary);
-		
-		in->height = 1;
-		
-		prepareRowByRow();
-		
-		hsh_save_uncompressed_header(outfile);
-		
+		coefficients.resize(image*PTM_TERMS);
+		for (int c=0; c<channels; c++)
+		{
+			for (int t=0; t<PTM_TERMS; t++)
+			{
+				const float * float_ptr = &(result[image*t+(size_t)plane*c]);
+				float * out_ptr = &(coefficients[(size_t)plane*PTM_TERMS*c+t]);
+				for (int i=0; i<plane; i++)
+					out_ptr[(size_t)i*PTM_TERMS] = 255*float_ptr[i] - offset[t];
+			}
+		}
 	}
 	else
 	{
-		// the 'all in memory' case
-		outfile.open(in->str_output_filename.c_str(),ios::binary);
+		coefficients.resize((size_t)plane*PTM_TERMS);
+		colors.resize((size_t)plane*3);
+#pragma omp parallel for num_threads(in->numberOfThreads)
+		for (int i=0; i<plane; i++)
+		{
+			float a[3][PTM_TERMS], sums[3], mean_sum = 0;
+			for (int c=0; c<channels; c++)
+			{
+				sums[c] = 0;
+				for (int t=0; t<PTM_TERMS; t++)
+				{
+					a[c][t] = 255*result[image*t+(size_t)plane*c+i] - offset[t];
+					sums[c] += a[c][t]*ptm_sums[t];
+				}
+				mean_sum += sums[c]/channels;
+			}
+			
+			float chroma[3] = { 1, 1, 1 }, gain = 1;
+			if (channels == 3 && mean_sum > 0)
+			{
+				gain = 0;
+				for (int c=0; c<3; c++)
+				{
+					chroma[c] = max(sums[c], 0.0f)/mean_sum;
+					gain = max(gain, chroma[c]);
+				}
+			}
+			
+			for (int t=0; t<PTM_TERMS; t++)
+			{
+				float luminance = 0;
+				for (int c=0; c<channels; c++)
+					luminance += a[c][t];
+				coefficients[(size_t)i*PTM_TERMS+t] = gain*luminance/channels;
+			}
+			for (int c=0; c<3; c++)
+				colors[(size_t)i*3+c] = (uchar)min(255*chroma[c]/gain + 0.5f, 255.0f);
+		}
 	}
 	
-	int image = width*in->height;
-	
-	if (in->is_compressed)  // initialize minimum and maximum bounds for 'compressed' format
+	for (size_t i=0; i<coefficients.size(); i+=PTM_TERMS)
 	{
-		min_term.resize(terms);
-		max_term.resize(terms);
-		for (int i=0;i<terms;i++)
+		for (int t=0; t<PTM_TERMS; t++)
 		{
-			min_term[i] = FLT_MAX;
-			max_term[i] = -FLT_MAX;
+			if (coefficients[i+t]<ptm_min[t]) ptm_min[t] = coefficients[i+t];
+			if (coefficients[i+t]>ptm_max[t]) ptm_max[t] = coefficients[i+t];
 		}
 	}
 	
-	term_ptr.resize(terms); // used to track term blocks when saving HSHs
+	started = lap(STAGE_QUANTIZE, started);
 	
-	make_hsh_matrix();
-	
-	float * mat_float_a = (float*)malloc(sizeof(float)*terms*terms);
-	float * mat_float_a_backup = (float*)malloc(sizeof(float)*terms*terms);
+	bool written = fwrite(&(coefficients[0]), sizeof(float), coefficients.size(), store) == coefficients.size();
+	if (!colors.empty())
+		written = written && fwrite(&(colors[0]), 1, colors.size(), store) == colors.size();
+	spill_bytes += sizeof(float)*coefficients.size() + colors.size();
+	lap(STAGE_WRITE, started);
+	return written;
+}
+
+/**
+ * Writes the 8 bit PTM from the blocks stored by ptm_store_block. Every term has one scale and
+ * bias over the image, its range includes 0 so the bias is within [0, 255] as the format requires.
+ * The rows of a PTM go from the bottom of the image to the top.
+ */
+bool HshCore::ptm_save(FILE * store, ofstream & savefile)
+{
+	bool lrgb = (in->ptm_format == PTM_LRGB);
+	float scale[PTM_TERMS];
+	int bias[PTM_TERMS];
+	for (int t=0; t<PTM_TERMS; t++)
+	{
+		float low = min(ptm_min[t], 0.0f), high = max(ptm_max[t], 0.0f);
+		scale[t] = (high > low) ? (high-low)/255 : 1;
+		bias[t] = min(max((int)(-low/scale[t] + 0.5f), 0), 255);
+	}
 	
-	/**
-	 * Multiplying A * AT
-	 * The result is a [TERMS][TERMS] matrix -> mat_float_a
-	 *
-	 */
-	char trans = 'T';
-	char noTrans = 'N';
-	float alpha = 1.0;
-	float beta = 0.0;
+	// the viewer splits the header on '\n' only
+	savefile << "PTM_1.2\n" << (lrgb ? "PTM_FORMAT_LRGB" : "PTM_FORMAT_RGB") << "\n";
+	savefile << in->width << "\n" << in->fullheight << "\n";
+	for (int t=0; t<PTM_TERMS; t++)
+		savefile << (t ? " " : "") << scale[t];
+	savefile << "\n";
+	for (int t=0; t<PTM_TERMS; t++)
+		savefile << (t ? " " : "") << bias[t];
+	savefile << "\n";
+	
+	size_t row_terms = (size_t)in->width*PTM_TERMS;
+	double block_bytes = lrgb ? (double)in->height*(sizeof(float)*row_terms + 3*in->width)
+							  : (double)in->height*in->channels*sizeof(float)*row_terms;
+	int blocks = (in->fullheight + in->height - 1) / in->height;
+	
+	// RGB : the coefficients of the red, green and blue channels (grey images repeat theirs),
+	// LRGB : the luminance coefficients then the colors
+	vector<float> section;
+	vector<uchar> out_row(row_terms);
+	int sections = lrgb ? 1 : 3;
+	for (int s=0; s<sections; s++)
+	{
+		for (int k=blocks-1; k>=0; k--)
+		{
+			int rows = min(in->height, in->fullheight-k*in->height);
+			double started = omp_get_wtime();
+			section.resize(rows*row_terms);
+			if (!seek_file(store, k*block_bytes + (double)min(s, in->channels-1)*rows*row_terms*sizeof(float))
+				|| fread(&(section[0]), sizeof(float), section.size(), store) != section.size())
+				return false;
+			started = lap(STAGE_WRITE, started);
+			
+			for (int r=rows-1; r>=0; r--)
+			{
+				const float * row = &(section[r*row_terms]);
+				for (size_t i=0; i<row_terms; i++)
+				{
+					int t = i%PTM_TERMS;
+					float value = row[i]/scale[t] + bias[t] + 0.5f;
+					out_row[i] = (uchar)min(max(value, 0.0f), 255.0f);
+				}
+				started = lap(STAGE_QUANTIZE, started);
+				savefile.write((char *)&(out_row[0]), row_terms);
+				started = lap(STAGE_WRITE, started);
+			}
+		}
+	}
 	
-#ifndef __APPLE__	
+	if (lrgb)
+	{
+		vector<uchar> colors;
+		for (int k=blocks-1; k>=0; k--)
+		{
+			int rows = min(in->height, in->fullheight-k*in->height);
+			double started = omp_get_wtime();
+			colors.resize((size_t)rows*in->width*3);
+			if (!seek_file(store, k*block_bytes + (double)rows*row_terms*sizeof(float))
+				|| fread(&(colors[0]), 1, colors.size(), store) != colors.size())
+				return false;
+			for (int r=rows-1; r>=0; r--)
+				savefile.write((char *)&(colors[(size_t)r*in->width*3]), in->width*3);
+			lap(STAGE_WRITE, started);
+		}
+	}
+	
+	return savefile.good();
+}
+
+/**
+ * Writes the tiles of the remote viewer to in->str_web_dir, the descriptor is named after the
+ * directory like the ones of rtiwebmaker, with the extension of the HSH file (.rti by default).
+ */
+bool HshCore::web_save(HshWebWriter * web)
+{
+	string directory = in->str_web_dir;
+	while (directory.size() > 1 && (directory[directory.size()-1] == '/' || directory[directory.size()-1] == '\\'))
+		directory.erase(directory.size()-1);
+	size_t slash = directory.find_last_of("/\\");
+	string name = (slash == string::npos) ? directory : directory.substr(slash+1);
+	
+	size_t dot = in->str_output_filename.find_last_of('.');
+	if (dot != string::npos && in->str_output_filename.find_first_of("/\\", dot) == string::npos)
+		name += in->str_output_filename.substr(dot);
+	else
+		name += ".rti";
+	
+	double memory = in->mem_limit > 0 ? in->mem_limit : MEMORY_FRACTION*available_memory();
+	double started = omp_get_wtime();
+	bool saved = web->save(directory, name, in->numberOfThreads, memory);
+	lap(STAGE_TILES, started);
+	
+	bytes_written += web->bytes_written;
+	spill_bytes += web->spill_bytes;
+	if (saved)
+		*output << "Web tiles : " << directory << ", descriptor " << name << endl;
+	else
+		*output << "Unable to write the web tiles to " << directory << endl;
+	return saved;
+}
+
+void initializeMatrix(float * matrix,int width,int height){
+	for(int i = 0; i < height; i++){
+		for(int j=0; j < width; j++){
+			matrix[i*width+j] = 0.0;
+		}
+	}
+}
+
+/**
+ * Computes the [terms][terms] normal matrix A^T*A of the [terms][num_used] 'basis' in 'factor'
+ * and factors it in place as U^T*U (Cholesky, it is symmetric positive definite whenever
+ * the light directions span the basis). Returns false if the factorization fails.
+ */
+bool HshCore::factor_normal_matrix(float * basis, float * factor, int terms)
+{
+	char trans = 'T';
+	char noTrans = 'N';
+	float alpha = 1.0;
+	float beta = 0.0;
+	
+#ifndef __APPLE__	
 	sgemm_(&trans, &noTrans, &terms, &terms,
-		   &(in->num_used), &alpha, hsh_matrix, &(in->num_used), hsh_matrix, &(in->num_used),
-		   &beta, mat_float_a, &terms);
+		   &(in->num_used), &alpha, basis, &(in->num_used), basis, &(in->num_used),
+		   &beta, factor, &terms);
 #else
 	SGEMM(&trans, &noTrans, &terms, &terms,
-		   &(in->num_used), &alpha, hsh_matrix, &(in->num_used), hsh_matrix, &(in->num_used),
-		   &beta, mat_float_a, &terms);
+		   &(in->num_used), &alpha, basis, &(in->num_used), basis, &(in->num_used),
+		   &beta, factor, &terms);
+#endif
+	
+	char upper = 'U';
+
+#ifndef __APPLE__
+	int info = 0;
+	spotrf_(&upper, &terms, factor, &terms, &info);
+#else
+	__CLPK_integer n = terms, lda = terms, info = 0;
+	spotrf_(&upper, &n, factor, &lda, &info);
+#endif
+
+	if (info != 0)
+	{
+		*output << "Normal matrix of the " << terms << " term basis is singular (spotrf info = " << info << "), "
+			 << "check the light positions" << endl;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Solves X * (U^T*U) = B in place for 'count' pixels starting at 'first'.
+ * B is a [pixels][terms] column-major block (mat_float_b) with leading dimension 'ld',
+ * so every pixel is one right hand side and all of them share the factorization.
+ */
+void HshCore::back_substitute(const FitBasis & basis, float * result, int first, int count, int ld)
+{
+	if (count <= 0) return;
+
+	int terms = basis.terms;
+	float * b = &(result[first]);
+	float one = 1.0;
+	char right = 'R', upper = 'U', noTrans = 'N', trans = 'T', nonUnit = 'N';
+
+#ifndef __APPLE__
+	strsm_(&right, &upper, &noTrans, &nonUnit, &count, &terms, &one, basis.factor, &terms, b, &ld);
+	strsm_(&right, &upper, &trans, &nonUnit, &count, &terms, &one, basis.factor, &terms, b, &ld);
+#else
+	cblas_strsm(CblasColMajor, CblasRight, CblasUpper, CblasNoTrans, CblasNonUnit,
+				count, terms, one, basis.factor, terms, b, ld);
+	cblas_strsm(CblasColMajor, CblasRight, CblasUpper, CblasTrans, CblasNonUnit,
+				count, terms, one, basis.factor, terms, b, ld);
+#endif
+}
+
+/**
+ * Projects 'data' onto the basis (basis.matrix[terms][num_used] * data[num_used][image],
+ * written in 'result') and solves the normal equations for every pixel.
+ * 'data' holds one [channels][pixels] slice per light, every channel plane is
+ * projected by its own sgemm and lands in the same plane of every term of 'result'.
+ */
+void HshCore::project_and_solve(const FitBasis & basis, float * data, float * result, int image)
+{
+	int terms = basis.terms;
+	int plane = image/in->channels;
+	char noTrans = 'N';
+	float alpha = 1.0;
+	float beta = 0.0;
+	double started = omp_get_wtime();
+
+	for (int c=0; c<in->channels; c++)
+	{
+#ifndef __APPLE__
+		sgemm_(&noTrans, &noTrans,
+			   &plane, &terms,
+			   &(in->num_used), &alpha, &(data[c*plane]), &(image), basis.matrix,
+			   &(in->num_used), &beta, &(result[c*plane]), &image);
+#else
+		SGEMM(&noTrans, &noTrans,
+			   &plane, &terms,
+			   &(in->num_used), &alpha, &(data[c*plane]), &(image), basis.matrix,
+			   &(in->num_used), &beta, &(result[c*plane]), &image);
+#endif
+	}
+
+	started = lap(STAGE_SGEMM, started);
+
+	// every pixel of the block is solved, in panels handed out dynamically to the threads
+#pragma omp parallel for schedule(dynamic) num_threads(in->numberOfThreads)
+	for (int first=0; first<image; first+=SOLVE_PANEL_PIXELS)
+		back_substitute(basis, result, first, min(SOLVE_PANEL_PIXELS, image-first), image);
+
+	lap(STAGE_SOLVE, started);
+}
+
+/**
+ * Robust refinement of a least squares fit. Every iteration predicts all samples
+ * from the current coefficients, replaces the samples whose residual is larger than
+ * ROBUST_THRESHOLD robust standard deviations of that pixel (shadows, specular spikes)
+ * by their prediction and fits again. The basis and the factored normal matrix stay
+ * the same, so an iteration costs two sgemm and one batched solve.
+ */
+void HshCore::refit_robust(const FitBasis & basis, float * staging, float * result, int image)
+{
+	int terms = basis.terms;
+	int num_used = in->num_used;
+	char noTrans = 'N', trans = 'T';
+	float alpha = 1.0;
+	float beta = 0.0;
+
+	for (int iteration=0; iteration<in->robust_iterations; iteration++)
+	{
+		double started = omp_get_wtime();
+
+		// predicted[image][num_used] = result[image][terms] * basis.matrix^T
+#ifndef __APPLE__
+		sgemm_(&noTrans, &trans,
+			   &image, &num_used, &terms,
+			   &alpha, result, &image, basis.matrix, &num_used,
+			   &beta, mat_float_robust, &image);
+#else
+		SGEMM(&noTrans, &trans,
+			   &image, &num_used, &terms,
+			   &alpha, result, &image, basis.matrix, &num_used,
+			   &beta, mat_float_robust, &image);
 #endif
+
+		long outliers = 0;
+#pragma omp parallel num_threads(in->numberOfThreads) reduction(+:outliers)
+		{
+			// pixels are handled in panels transposed to [pixel][light], so the per-pixel
+			// statistics read contiguous memory and the planes are still walked in order
+			float * residual = &(robust_scratch[(size_t)omp_get_thread_num()*ROBUST_PANEL_PIXELS*num_used]);
+			
+#pragma omp for schedule(dynamic)
+			for (int first=0; first<image; first+=ROBUST_PANEL_PIXELS)
+			{
+				int count = min(ROBUST_PANEL_PIXELS, image-first);
+				
+				for (int i=0; i<num_used; i++)
+				{
+					const float * measured = &(staging[(size_t)i*image+first]);
+					const float * predicted = &(mat_float_robust[(size_t)i*image+first]);
+					for (int p=0; p<count; p++)
+						residual[p*num_used+i] = measured[p] - predicted[p];
+				}
+				
+				for (int p=0; p<count; p++)
+				{
+					float * r = &(residual[p*num_used]);
+					
+					// robust spread of the residuals : RMS of the samples within twice the plain RMS,
+					// so a few shadows or highlights can not inflate the threshold that rejects them
+					float sum = 0;
+					for (int i=0; i<num_used; i++)
+						sum += r[i]*r[i];
+					float cut = 4*sum/num_used;
+					float inlier_sum = 0, inliers = 0;
+					for (int i=0; i<num_used; i++)
+					{
+						float r2 = r[i]*r[i];
+						if (r2 <= cut)
+						{
+							inlier_sum += r2;
+							inliers++;
+						}
+					}
+					float threshold = max(ROBUST_THRESHOLD*sqrt(inlier_sum/max(inliers,1.0f)), ROBUST_MIN_RESIDUAL);
+					
+					// flag the outliers by zeroing their residual
+					for (int i=0; i<num_used; i++)
+					{
+						if (fabs(r[i]) > threshold)
+						{
+							r[i] = 0;
+							outliers++;
+						}
+					}
+				}
+				
+				// robust input = prediction + residual, i.e. the measured inliers and the predicted outliers
+				for (int i=0; i<num_used; i++)
+				{
+					float * predicted = &(mat_float_robust[(size_t)i*image+first]);
+					for (int p=0; p<count; p++)
+						predicted[p] += residual[p*num_used+i];
+				}
+			}
+		}
+		
+		lap(STAGE_ROBUST, started);
+
+		if (outliers == 0)
+			break;
+		
+		project_and_solve(basis, mat_float_robust, result, image);
+	}
+}
+
+/**
+ * Fits one block of 'rows' scanlines stored in 'staging' to 'basis', the coefficients are written in 'result'.
+ */
+void HshCore::fit_block(const FitBasis & basis, float * staging, float * result, int rows)
+{
+	int image = in->width*in->channels*rows;
+
+	project_and_solve(basis, staging, result, image);
+
+	if (in->robust_iterations > 0)
+		refit_robust(basis, staging, result, image);
+}
+
+/**
+ * Memory this process may use, in bytes : the physical memory, or the cgroup limit
+ * of the job if there is a smaller one (batch schedulers kill jobs that exceed it).
+ */
+double HshCore::available_memory()
+{
+#if _WIN32
+	MEMORYSTATUSEX statex;
+	statex.dwLength = sizeof(statex);
+	GlobalMemoryStatusEx(&statex);
+	return (double)statex.ullTotalPhys;
+#else
+	double memory = (double)sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGE_SIZE);
+	const char * cgroup_limits[] = { "/sys/fs/cgroup/memory.max", "/sys/fs/cgroup/memory/memory.limit_in_bytes" };
+	for (int i=0; i<2; i++)
+	{
+		ifstream limit_file(cgroup_limits[i]);
+		double limit;
+		if (limit_file >> limit && limit > 0 && limit < memory) // "max" means no limit and fails to parse
+			memory = limit;
+	}
+	return memory;
+#endif
+}
+
+/**
+ * Peak resident memory of the process so far, in bytes.
+ */
+static double peak_resident_memory()
+{
+#if _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0;
+	return (double)counters.PeakWorkingSetSize;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage))
+		return 0;
+#ifdef __APPLE__
+	return (double)usage.ru_maxrss; // bytes on MacOs
+#else
+	return (double)usage.ru_maxrss*1024; // kilobytes on Linux
+#endif
+#endif
+}
+
+/**
+ * Size of a file in bytes, 0 if it is not a file (images registered in memory).
+ */
+static double file_bytes(const string & filename)
+{
+	struct stat info;
+	if (stat(filename.c_str(), &info))
+		return 0;
+	return (double)info.st_size;
+}
+
+/**
+ * Quotes a string for JSON.
+ */
+static string json_string(const string & text)
+{
+	string quoted = "\"";
+	for (size_t i=0; i<text.size(); i++)
+	{
+		if (text[i] == '"' || text[i] == '\\')
+			quoted += '\\';
+		if ((unsigned char)text[i] >= 0x20)
+			quoted += text[i];
+	}
+	return quoted + "\"";
+}
+
+/**
+ * Writes the statistics of the last compute_loop as a JSON object, for job schedulers.
+ */
+bool HshCore::write_stats(const string & filename)
+{
+	ofstream stats(filename.c_str());
+	if (!stats)
+	{
+		*output << "Unable to write the statistics to " << filename << endl;
+		return false;
+	}
+	
+	write_stats(stats);
+	return stats.good();
+}
+
+void HshCore::write_stats(ostream & stats)
+{
+	stats << "{\n";
+	stats << "  \"output\": " << json_string(in->str_output_filename) << ",\n";
+	if (!in->str_web_dir.empty())
+		stats << "  \"web_output\": " << json_string(in->str_web_dir) << ", \"web_levels\": " << in->web_levels << ",\n";
+	if (in->ptm_format != PTM_NONE)
+		stats << "  \"ptm_output\": " << json_string(in->str_ptm_filename) << ", \"ptm_format\": \""
+			  << (in->ptm_format == PTM_LRGB ? "LRGB" : "RGB") << "\",\n";
+	stats << "  \"width\": " << in->width << ", \"height\": " << in->fullheight << ", \"channels\": " << in->channels
+		  << ", \"lights\": " << in->num_used << ", \"order\": " << in->order << ",\n";
+	stats << "  \"mode\": \"" << (in->is_row_by_row ? "row-by-row" : "in-memory") << "\", \"block_rows\": " << in->height
+		  << ", \"compressed\": " << (in->is_compressed ? "true" : "false") << ", \"robust_iterations\": " << in->robust_iterations
+		  << ", \"threads\": " << in->numberOfThreads << ",\n";
+	if (in->rect_angle != 0)
+		stats << "  \"rectification_degrees\": " << in->rect_angle << ",\n";
+	stats << "  \"seconds\": " << total_time << ",\n";
+	stats << "  \"stage_seconds\": {";
+	for (int s=0; s<STAGE_COUNT; s++)
+		stats << (s ? ", " : " ") << "\"" << hsh_stage_names[s] << "\": " << stage_time[s];
+	stats << " },\n";
+	stats << "  \"rows_per_second\": " << ((total_time > 0) ? in->fullheight/total_time : 0) << ",\n";
+	stats << "  \"bytes_read\": " << (long long)bytes_read << ", \"bytes_written\": " << (long long)bytes_written
+		  << ", \"spill_bytes\": " << (long long)spill_bytes << ",\n";
+	stats << "  \"peak_rss_bytes\": " << (long long)peak_rss << "\n";
+	stats << "}\n";
+}
+
+/**
+ * Estimated peak memory, in bytes, of a fit done in blocks of 'rows' scanlines
+ * by the row based reader, or of the all in memory fit.
+ */
+double HshCore::estimate_footprint(bool row_by_row, int rows)
+{
+	double terms = in->str_output_filename.empty() ? 0 : in->order*in->order;
+	double ptm_terms = (in->ptm_format != PTM_NONE) ? PTM_TERMS : 0;
+	double lights = in->num_used;
+	double row = (double)in->width*in->channels;
+	double block = row*rows;
+	
+	// staging and results, double buffered by the row-by-row pipeline,
+	// and the pixel unit copy of a block of PTM coefficients before it is stored
+	double bytes = sizeof(float)*block*(lights+terms+ptm_terms)*(row_by_row ? 2 : 1);
+	bytes += sizeof(float)*block*ptm_terms;
+	if (in->robust_iterations > 0)
+		bytes += sizeof(float)*(block + (double)in->numberOfThreads*ROBUST_PANEL_PIXELS)*lights;
+	
+	if (row_by_row)
+	{
+		// an open decompressor and a float row for every image,
+		// and the 16 bit and 8 bit copies of a block when saving compressed
+		bytes += lights*row*(DECODER_ROWS + sizeof(float));
+		if (in->is_compressed)
+			bytes += block*terms*(sizeof(unsigned short) + 1);
+	}
+	else
+		bytes += sizeof(float)*SAVE_BLOCK_PIXELS*terms*in->channels;
 	
+	// a pending row, a reduced row and a copy of a row for each mip level of the web output
+	if (!in->str_web_dir.empty())
+		bytes += 3*WEB_MIP_LEVELS*sizeof(float)*row*terms;
 	
-	memcpy(mat_float_a_backup,mat_float_a,sizeof(float) * terms * terms);
+	// the window of source rows of the axis rectification, or the copy of the plane being warped
+	if (in->rect_angle != 0)
+	{
+		ImageRectifier rectifier(in->width, in->fullheight, in->rect_angle);
+		bytes += sizeof(float)*(row_by_row ? lights*row*rectifier.plan(rows) : (double)in->width*in->fullheight);
+	}
 	
-	mat_float = (float *)malloc(sizeof(float) * image * in->num_used);
+	return bytes;
+}
+
+/**
+ * Chooses the fastest way of fitting within the memory limit : everything in memory
+ * if it fits, otherwise the row-by-row pipeline with the largest block that fits.
+ */
+void HshCore::plan_memory()
+{
+	double limit = in->mem_limit > 0 ? in->mem_limit : MEMORY_FRACTION*available_memory();
+	double in_memory = estimate_footprint(false, in->fullheight);
 	
-	mat_float_b = (float *)malloc(sizeof(float) * terms * image);
-	mat_float_b_backup = (float *)malloc(sizeof(float) * terms * image);
+	*output << "Memory limit : " << (int)(limit/1048576) << "MB, all in memory fit needs "
+		 << (int)(in_memory/1048576) << "MB" << endl;
 	
-	omp_set_num_threads(in->numberOfThreads);
+	if (in_memory <= limit)
+	{
+		in->is_row_by_row = false;
+		return;
+	}
 	
-	cout << "Number of Threads : " << in->numberOfThreads << endl;
+	// the footprint grows linearly with the rows of a block
+	// (the rectification window has at least one row, so the slope is taken between one and two rows)
+	double per_row = estimate_footprint(true, 2) - estimate_footprint(true, 1);
+	double fixed = estimate_footprint(true, 1) - per_row;
+	int rows = (int)min((limit - fixed)/per_row, (double)min(in->fullheight, MAX_BLOCK_ROWS));
+	if (rows < 1)
+	{
+		*output << "Memory limit too low, using the row-by-row reader with single rows" << endl;
+		rows = 1;
+	}
 	
-	for (int row=0; row<in->fullheight; row+=in->height)
+	in->is_row_by_row = true;
+	in->block_rows = rows;
+	*output << "Using the row-by-row reader, " << rows << " rows per block need "
+		 << (int)(estimate_footprint(true, rows)/1048576) << "MB" << endl;
+}
+
+bool HshCore::compute_loop()
+{
+	
+	double started = omp_get_wtime();
+	for (int s=0; s<STAGE_COUNT; s++)
+		stage_time[s] = 0;
+	bytes_read = bytes_written = spill_bytes = 0;
+	progress_started = last_progress = started;
+	for (int i=0; i<in->num_used; i++)
+		bytes_read += file_bytes(in->lit_images[i].filename);
+	ofstream outfile, ptmfile;
+	bool hsh_output = !in->str_output_filename.empty();
+	bool ptm_output = (in->ptm_format != PTM_NONE);
+	int terms = hsh_output ? in->order*in->order : 0;
+	
+	if (!in->str_web_dir.empty() && !hsh_output)
+		*output << "The web tiles hold an HSH, no tiles without an HSH output" << endl;
+	
+	int width = in->width*in->channels;
+	
+	if (in->is_auto_plan)
+		plan_memory();
+	
+	
+	FILE * spill = NULL;
+	FILE * ptm_store = NULL;
+	HshWebWriter * web = NULL;
+	
+	if (hsh_output)
 	{
-		
-		if (in->is_row_by_row)
+		outfile.open(in->str_output_filename.c_str(),ios::binary);
+		if (!outfile)
 		{
-			stack_all_rows();
+			*output << "Unable to create the output file " << in->str_output_filename << endl;
+			return false;
 		}
-		else
+	}
+	
+	if (ptm_output) // the PTM is quantized over the whole image, blocks are kept as floats until its bounds are known
+	{
+		ptmfile.open(in->str_ptm_filename.c_str(),ios::binary);
+		ptm_store = ptmfile ? tmpfile() : NULL;
+		if (!ptm_store)
 		{
-			stack_all_images2();
-			cout << "Single large image matrix created! " << endl;
+			*output << "Unable to create the PTM file " << in->str_ptm_filename << " or its temporary file" << endl;
+			return false;
 		}
+	}
+	
+	if (hsh_output && !in->str_web_dir.empty()) // the mip levels are built as the rows arrive, the tiles are cut at the end
+	{
+		web = new HshWebWriter(in->width, in->fullheight, in->channels, in->order, in->web_levels);
+		if (!web->open())
+		{
+			*output << "Unable to create the temporary files of the web tiles" << endl;
+			delete web;
+			if (ptm_store) fclose(ptm_store);
+			return false;
+		}
+	}
+	
+	if (in->is_row_by_row)
+	{
+		if (hsh_output && in->is_compressed) // row-by-row and compressed, blocks are kept as 16 bit values until the global bounds are known
+		{
+			spill = tmpfile();
+			if (!spill)
+			{
+				*output << "Unable to create a temporary file for the compressed output" << endl;
+				outfile.close();
+				if (ptm_store) fclose(ptm_store);
+				delete web;
+				return false;
+			}
+		}
+		
+		// fit 'block_rows' scanlines per pass, one sgemm and one batched solve for the whole block
+		in->height = in->block_rows;
+		if (in->height < 1) in->height = 1;
+		if (in->height > in->fullheight) in->height = in->fullheight;
+		*output << "Rows per block : " << in->height << endl;
+		
+		if (!prepareRowByRow())
+		{
+			destroyRowByRow();
+			if (spill) fclose(spill);
+			if (ptm_store) fclose(ptm_store);
+			delete web;
+			outfile.close();
+			return false;
+		}
+		
+		if (hsh_output && !spill)
+			hsh_save_uncompressed_header(outfile);
 		
+	}
+	
+	int block_size = width*in->height; // largest block, the last one may have fewer rows
+	
+	if (in->is_compressed)  // initialize minimum and maximum bounds for 'compressed' format
+	{
+		min_term.resize(terms);
+		max_term.resize(terms);
+		for (int i=0;i<terms;i++)
+		{
+			min_term[i] = FLT_MAX;
+			max_term[i] = -FLT_MAX;
+		}
+	}
+	ptm_min.assign(PTM_TERMS, FLT_MAX);
+	ptm_max.assign(PTM_TERMS, -FLT_MAX);
+	
+	hsh_matrix = mat_float_a = ptm_matrix = ptm_factor = NULL;
+	if ((hsh_output && !prepare_basis()) || (ptm_output && !prepare_ptm_basis()))
+	{
+		outfile.close();
+		if (spill)
+			fclose(spill);
+		if (ptm_store)
+			fclose(ptm_store);
+		delete web;
+		if (in->is_row_by_row)
+			destroyRowByRow();
+		free(mat_float_a);
+		free(hsh_matrix);
+		free(ptm_factor);
+		free(ptm_matrix);
+		return false;
+	}
+	FitBasis hsh = { terms, hsh_matrix, mat_float_a };
+	FitBasis ptm = { PTM_TERMS, ptm_matrix, ptm_factor };
+	
+	omp_set_num_threads(in->numberOfThreads);
+	
+	*output << "Number of Threads : " << in->numberOfThreads << endl;
+	
+	mat_float_robust = NULL;
+	robust_scratch = NULL;
+	if (in->robust_iterations > 0)
+	{
+		*output << "Robust fitting : at most " << in->robust_iterations << " iterations" << endl;
+		mat_float_robust = (float *)malloc(sizeof(float) * block_size * in->num_used);
+		robust_scratch = (float *)malloc(sizeof(float) * in->numberOfThreads * ROBUST_PANEL_PIXELS * in->num_used);
+	}
+	
+	rectifier = NULL;
+	rect_window = NULL;
+	if (in->rect_angle != 0)
+	{
+		rectifier = new ImageRectifier(in->width, in->fullheight, in->rect_angle);
+		*output << "Rectifying : rotation of " << in->rect_angle << " degrees";
+		if (in->is_row_by_row) // the readers fill a window of source rows, the blocks are warped from it
+		{
+			rect_window_rows = rectifier->plan(in->height);
+			rect_rows_read = rect_block = 0;
+			rect_window = (float *)malloc(sizeof(float) * width * rect_window_rows * in->num_used);
+			*output << ", " << rect_window_rows << " source rows kept";
+		}
+		*output << endl;
+	}
+	
+	bool stored = true; // every image was read and every block written
+	if (in->is_row_by_row)
+	{
 		/**
-		 Multiplication of hsh_matrix[terms][num_used] * mat_float[num_used][image]
-		 The result is written in mat_float_b
+		 * Three stage pipeline over blocks of rows : while block k is fitted, the
+		 * decoders fill the other staging buffer with block k+1 and the writer
+		 * flushes the result of block k-1, so staging and results are double buffered.
+		 * Both bases are fitted from the same staged samples.
 		 */
-
-#ifndef __APPLE__		
-		sgemm_(&noTrans, &noTrans,
-			   &image, &terms,
-			   &(in->num_used), &alpha, mat_float, &(image), hsh_matrix,
-			   &(in->num_used), &beta, mat_float_b, &image);
-#else
-		//cout << "Start SGEMM 2" << endl;
-		/*cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans,
-					image, terms,
-					in->num_used, alpha, mat_float, image, hsh_matrix,
-					in->num_used, beta, mat_float_b, image);*/
-		SGEMM(&noTrans, &noTrans,
-			   &image, &terms,
-			   &(in->num_used), &alpha, mat_float, &(image), hsh_matrix,
-			   &(in->num_used), &beta, mat_float_b, &image);
-		//cout << "Start SGEMM 2" << endl;
-#endif
+		float * staging[2];
+		float * result[2] = { NULL, NULL };
+		float * ptm_result[2] = { NULL, NULL };
+		for (int i=0; i<2; i++)
+		{
+			staging[i] = (float *)malloc(sizeof(float) * block_size * in->num_used);
+			if (hsh_output)
+				result[i] = (float *)malloc(sizeof(float) * terms * block_size);
+			if (ptm_output)
+				ptm_result[i] = (float *)malloc(sizeof(float) * PTM_TERMS * block_size);
+		}
+		mat_float = staging[0];
+		mat_float_b = result[0];
+		
+		int blocks = (in->fullheight + in->height - 1) / in->height;
 		
+		// decoding and fitting both run their own parallel loops inside the pipeline stages
+		// (a batch running several fits at once has already allowed one more level)
+		if (omp_get_max_active_levels() < 2)
+			omp_set_max_active_levels(2);
 		
-		int * chunkMin = (int*)malloc(sizeof(int)*in->numberOfThreads);
-		int * chunkMax = (int*)malloc(sizeof(int)*in->numberOfThreads);
-		int chunkSize = (int)(width/in->numberOfThreads);
+		// a block that cannot be read stops the pipeline before it is fitted
+		double decode_started = omp_get_wtime();
+		bool decoded = stack_all_rows(staging[0], min(in->height, in->fullheight));
+		lap(STAGE_DECODE, decode_started);
 		
-		for(int k = 0 ;k < in->numberOfThreads;k++)
+		for (int k=0; k<=blocks && decoded; k++)
 		{
-			chunkMin[k] = k*chunkSize;
-			chunkMax[k] = k*chunkSize+chunkSize;
+#pragma omp parallel sections num_threads(3)
+			{
+#pragma omp section
+				{
+					if (k+1 < blocks)
+					{
+						double decode_started = omp_get_wtime();
+						decoded = stack_all_rows(staging[(k+1)%2], min(in->height, in->fullheight-(k+1)*in->height));
+						lap(STAGE_DECODE, decode_started);
+					}
+				}
+#pragma omp section
+				{
+					if (k < blocks)
+					{
+						int rows = min(in->height, in->fullheight-k*in->height);
+						if (hsh_output)
+							fit_block(hsh, staging[k%2], result[k%2], rows);
+						if (ptm_output)
+							fit_block(ptm, staging[k%2], ptm_result[k%2], rows);
+					}
+				}
+#pragma omp section
+				{
+					if (k > 0)
+					{
+						int rows = min(in->height, in->fullheight-(k-1)*in->height);
+						if (spill && !hsh_spill_block(spill, result[(k-1)%2], rows))
+							stored = false;
+						else if (!spill && hsh_output && !hsh_save_uncompressed(outfile, result[(k-1)%2], rows))
+							stored = false;
+						if (ptm_store && !ptm_store_block(ptm_store, ptm_result[(k-1)%2], rows))
+							stored = false;
+						if (web)
+						{
+							double started = omp_get_wtime();
+							if (!web->add_rows(result[(k-1)%2], rows))
+								stored = false;
+							lap(STAGE_TILES, started);
+						}
+					}
+				}
+			}
+			
+			if (k > 0)
+				report_progress(min(k*in->height, in->fullheight), in->fullheight, "rows");
 		}
-		int um=1;
-#pragma omp parallel
+		
+		free(staging[1]);
+		free(result[1]);
+		free(ptm_result[0]);
+		free(ptm_result[1]);
+		
+		if (!decoded)
 		{
-			int singular;
-			
-			float * mat_float_a_backupPerThread = (float*)malloc(sizeof(float)*terms*terms);
-			float* mat_float_b_column = (float*)malloc(sizeof(float) * 3 * terms);
-			
-#ifndef __APPLE__
-			int * ipiv = (int*)malloc(sizeof(int)*terms);
-#else
-			__CLPK_integer * ipiv = (__CLPK_integer*)malloc(sizeof(__CLPK_integer)*terms);
-#endif
-			
-			int id=omp_get_thread_num();
-			for(int a=chunkMin[id]; a < chunkMax[id]; a++){
-				
-				delColumn(mat_float_b_column,a,terms,width);
-				
-				memcpy(mat_float_a_backupPerThread,mat_float_a,sizeof(float) * terms * terms);
-				
-#ifndef __APPLE__
-				sgesv_(&terms,&um,
-					   mat_float_a_backupPerThread,&terms,
-					   ipiv,
-					   mat_float_b_column,&width,&singular);
-#else
-				__CLPK_integer  n=terms, nrhs = um, lda = n, ldb = n, info=0;
-				sgesv_(&n, &nrhs, mat_float_a_backupPerThread, &lda, ipiv,mat_float_b_column, &ldb, &info);
-#endif
-				
-				addColumn(mat_float_b_column,a,terms,width);
-				
-			}// End for
-		} //end parallel
+			*output << "Unable to read the lit images, the fit is aborted" << endl;
+			stored = false;
+		}
 		
-		if (in->is_row_by_row)
-			hsh_save_uncompressed(outfile,mat_float_b_backup);
+		if (spill)
+		{
+			if (stored && !hsh_save_spilled(spill, outfile))
+				stored = false;
+			fclose(spill);
+		}
+	}
+	else
+	{
+		mat_float = (float *)malloc(sizeof(float) * block_size * in->num_used);
+		mat_float_b = NULL;
 		
-		else
-			hsh_save(outfile,mat_float_b_backup);
+		double decode_started = omp_get_wtime();
+		if (!stack_all_images2())
+		{
+			*output << "Unable to read the lit images, the fit is aborted" << endl;
+			stored = false;
+		}
+		else if (rectifier)
+			rectify_all_images();
+		lap(STAGE_DECODE, decode_started);
+		if (stored)
+			*output << "Single large image matrix created! " << endl;
+		
+		if (hsh_output && stored)
+		{
+			mat_float_b = (float *)malloc(sizeof(float) * terms * block_size);
+			fit_block(hsh, mat_float, mat_float_b, in->height);
+			
+			if (in->is_compressed)
+				stored = hsh_save(outfile,mat_float_b);
+			else
+			{
+				hsh_save_uncompressed_header(outfile);
+				stored = hsh_save_uncompressed(outfile, mat_float_b, in->height);
+			}
+			
+			if (web)
+			{
+				double started = omp_get_wtime();
+				stored = web->add_rows(mat_float_b, in->height) && stored;
+				lap(STAGE_TILES, started);
+			}
+		}
 		
+		if (ptm_output && stored)
+		{
+			float * ptm_result = (float *)malloc(sizeof(float) * PTM_TERMS * block_size);
+			fit_block(ptm, mat_float, ptm_result, in->height);
+			stored = ptm_store_block(ptm_store, ptm_result, in->height) && stored;
+			free(ptm_result);
+		}
+	}
+	
+	bool written = true;
+	if (hsh_output)
+	{
+		bytes_written = (double)outfile.tellp();
+		written = stored && outfile.good();
+		outfile.close();
+	}
+	if (ptm_output)
+	{
+		written = stored && ptm_save(ptm_store, ptmfile) && written;
+		bytes_written += (double)ptmfile.tellp();
+		ptmfile.close();
+		fclose(ptm_store);
+	}
+	if (web)
+	{
+		// the fit is done, the tiles can use the memory of its buffers
+		free(mat_float_b);
+		free(mat_float);
+		mat_float_b = mat_float = NULL;
+		written = stored && web_save(web) && written;
+		delete web;
 	}
+	total_time = omp_get_wtime() - started;
+	peak_rss = peak_resident_memory();
 	
-	cout << "Time spent in compute_loop : " << (time(NULL) - start) << endl;
+	*output << "Time spent in compute_loop : " << total_time << " s, " << in->fullheight/total_time << " rows/s" << endl;
+	*output << "Stages (s) :";
+	for (int s=0; s<STAGE_COUNT; s++)
+		*output << " " << hsh_stage_names[s] << " " << stage_time[s];
+	*output << endl;
+	*output << "Read " << (long long)bytes_read << " bytes, wrote " << (long long)bytes_written << " bytes, peak memory "
+		 << (int)(peak_rss/1048576) << "MB" << endl;
 	
-	outfile.close();
+	if (!in->str_stats_filename.empty())
+		write_stats(in->str_stats_filename);
 	
 	if (in->is_row_by_row)
-	{
 		destroyRowByRow();
-		if (in->is_compressed) // if row-by-row and compressed, we have to re-save the file as compressed.
-			convert_hsh_raw_to_compressed("temp.hsh",in->str_output_filename.c_str());
-	}
 	
 	
 	free(mat_float_b);
 	free(mat_float);
 	free(hsh_matrix);
-	free(mat_float_b_backup);
-	
-	
-	
-	
+	free(mat_float_a);
+	free(ptm_matrix);
+	free(ptm_factor);
+	free(mat_float_robust);
+	free(robust_scratch);
+	free(rect_window);
+	delete rectifier;
+	
+	return written;
 }
@@ -31,50 +31,133 @@
 #include <iostream>
 #include "input.h"
 #include "image.h"
+#include "hsh_cache.h"
+#include "hsh_web.h"
+#include "rectify.h"
 
 using namespace std;
 
+// number of pixels transposed from channel planes to pixel-interleaved order per write
+#define SAVE_BLOCK_PIXELS 4096
+
+// memory planner : share of the available memory used when no limit is given, largest block
+// it chooses, and the approximate memory held by one open decompressor, in bytes per sample of a row
+#define MEMORY_FRACTION 0.6
+#define MAX_BLOCK_ROWS 256
+#define DECODER_ROWS 16
+
+// number of pixels per task of the parallel solve
+#define SOLVE_PANEL_PIXELS 2048
+
+// robust fitting : samples further than ROBUST_THRESHOLD robust standard deviations from the fit
+// are rejected, residuals below ROBUST_MIN_RESIDUAL (about two 8 bit steps) are always kept
+#define ROBUST_THRESHOLD 2.5f
+#define ROBUST_MIN_RESIDUAL (2/255.0f)
+#define ROBUST_PANEL_PIXELS 256
+
+// PTM output : biquadratic polynomial of the projection (lu, lv) of the light on the image plane,
+// a0*lu^2 + a1*lv^2 + a2*lu*lv + a3*lu + a4*lv + a5, in 8 bit pixel units as read by RGBPtm and LRGBPtm
+#define PTM_TERMS 6
+
+/**
+ * A basis the samples are fitted to : the [terms][num_used] matrix and the
+ * Cholesky factor of its normal matrix.
+ */
+struct FitBasis {
+	int terms;
+	float * matrix;
+	float * factor;
+};
+
+// stages timed by compute_loop, in seconds of wall time spent in each of them
+// (the readers decode straight into the staging buffers, so decode includes stacking and rectifying the images,
+// tiles includes building the mip levels of the web output)
+enum HshStage { STAGE_DECODE, STAGE_SGEMM, STAGE_SOLVE, STAGE_ROBUST, STAGE_QUANTIZE, STAGE_WRITE, STAGE_TILES, STAGE_COUNT };
+extern const char * hsh_stage_names[STAGE_COUNT];
+
 class HshCore{
 public:
-    HshCore(Input * data);
+    HshCore(Input * data, HshBasisCache * basis_cache = NULL);
     ~HshCore(){};
 
-    void compute_loop();
+    bool compute_loop();
+
+    ostream *output;		//  stream for capturing console text output, cout by default
+
+    double stage_time[STAGE_COUNT];	// filled by compute_loop, the pipelined stages overlap
+    double total_time;
+    double bytes_read;		// size of the input images
+    double bytes_written;	// size of the output files
+    double spill_bytes;		// blocks written to temporary files, row-by-row compressed HSH, PTM and web output only
+    double peak_rss;		// peak resident memory of the process, in bytes
+
+    bool write_stats(const string & filename);
+    void write_stats(ostream & stats);
 
-    ostream *output;		//  stream for capturing console text output
+    static double available_memory();
 
 
 private:
 
 	Input * in;
+	HshBasisCache * basis_cache;	// shared with the other fits of a batch, NULL for none
 
     void make_hsh_matrix();
-    bool convert_hsh_raw_to_compressed(const char *infilename,const char *outfilename);
+    bool prepare_basis();
+    bool prepare_ptm_basis();
+    bool hsh_spill_block(FILE * spill, float *hsh_matrix, int rows);
+    bool hsh_save_spilled(FILE * spill, ofstream &savefile);
+    void hsh_save_compressed_header(ofstream &savefile, int height);
     bool hsh_save(ofstream &savefile, float *hsh_matrix);
     void hsh_save_uncompressed_header(ofstream &savefile);
-    bool hsh_save_uncompressed(ofstream &savefile, float *hsh_matrix);
+    bool hsh_save_uncompressed(ofstream &savefile, float *hsh_matrix, int rows);
     void stack_all_images();
-    void stack_all_images2();
-    void stack_all_rows();
+    bool stack_all_images2();
+    bool stack_all_rows(float * staging, int rows);
+    bool stack_rectified_rows(float * staging, int rows);
+    void rectify_all_images();
 
-    void prepareRowByRow();
+    bool prepareRowByRow();
     void destroyRowByRow();
 
     void find_min_max(float * matrix, int row, float& min, float&max);
 
-    void delColumn(float * mat_float_b_coluna,int colunaI,int height,int width);
-    void addColumn(float * mat_float_b_coluna,int colunaI,int height,int width);
+    double estimate_footprint(bool row_by_row, int rows);
+    void plan_memory();
+
+    double lap(HshStage stage, double started);
+    void report_progress(int done, int total, const char * unit);
+    double progress_started, last_progress;
+
+    bool factor_normal_matrix(float * basis, float * factor, int terms);
+    void back_substitute(const FitBasis & basis, float * result, int first, int count, int ld);
+    void project_and_solve(const FitBasis & basis, float * data, float * result, int image);
+    void refit_robust(const FitBasis & basis, float * staging, float * result, int image);
+    void fit_block(const FitBasis & basis, float * staging, float * result, int rows);
+
+    bool ptm_store_block(FILE * store, float * result, int rows);
+    bool ptm_save(FILE * store, ofstream & savefile);
+    bool web_save(HshWebWriter * web);
 
     unsigned char * mat_all_images;
-    float * mat_float;
+    float * mat_float;        // staged samples, [light][channel][pixel]
     float * hsh_matrix;
-    float * mat_float_b;
-    float * mat_float_b_backup;
-    //float * mat_float_a;
+    float * mat_float_b;      // coefficients, [term][channel][pixel]
+    float * mat_float_robust; // predicted samples with outliers replaced, robust fitting only
+    float * robust_scratch;   // one [ROBUST_PANEL_PIXELS][num_used] panel per thread, robust fitting only
+    float * mat_float_a;
     //float * mat_float_a_backup;
+    float * ptm_matrix;       // PTM basis, [PTM_TERMS][num_used]
+    float * ptm_factor;       // Cholesky factor of the PTM normal matrix
+    float ptm_sums[PTM_TERMS]; // sum of each PTM term over the lights
+
+    ImageRectifier * rectifier; // axis rectification of the staged samples, NULL for none
+    float * rect_window;      // decoded source rows of every image, [light][channel][rect_window_rows][width], row-by-row only
+    int rect_window_rows, rect_rows_read, rect_block;
 
-    vector<float *> term_ptr;
     vector<float> min_term, max_term; // (min, max) for each term, used for generating 'compressed' HSHs
+    vector<unsigned short> spill_buffer; // one block of 16 bit coefficients, row-by-row 'compressed' HSHs
+    vector<float> ptm_min, ptm_max;     // bounds of each PTM term, in pixel units
 
     string str_debug_output;	// debug/info output stored in this string
 
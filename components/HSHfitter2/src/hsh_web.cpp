@@ -0,0 +1,479 @@
+/*  HSHFitter
+ *  Copyright (C) 2009-11 UC Santa Cruz and Cultural Heritage Imaging
+ *    
+ *  Portions Copyright (C) 2010-11 Univ. do Minho and Cultural Heritage Imaging
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 3 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <string.h>
+#include <float.h>
+#include <algorithm>
+#include <omp.h>
+#if _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+#include "hsh_web.h"
+#include "hsh_basis.h"
+#include "openjpeg.h"
+
+extern "C"{
+    #include "jpeglib.h"
+}
+
+/**
+ * Moves the read position of a temporary file, beyond 2GB on every system.
+ */
+static bool seek_file(FILE * file, double offset)
+{
+#if _WIN32
+	return _fseeki64(file, (__int64)offset, SEEK_SET) == 0;
+#else
+	return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+static string join_path(const string & directory, const string & name)
+{
+	char last = directory.empty() ? '/' : directory[directory.size()-1];
+	if (last == '/' || last == '\\')
+		return directory + name;
+	return directory + "/" + name;
+}
+
+HshWebWriter::HshWebWriter(int width, int height, int channels, int order, int levels) :
+	width(width), height(height), channels(channels), order(order), terms(order*order), levels(levels)
+{
+	samples = channels*terms;
+	
+	// every tile of the finest level keeps at least a pixel
+	this->levels = max(1, min(levels, WEB_MIP_LEVELS));
+	while (this->levels > 1 && ((width >> this->levels) < 1 || (height >> this->levels) < 1))
+		this->levels--;
+	spill_bytes = bytes_written = 0;
+	failed = false;
+	
+	// same sizes as the mip levels of the viewer
+	int w = width, h = height;
+	for (int l=0; l<WEB_MIP_LEVELS; l++)
+	{
+		level_width.push_back(w);
+		level_height.push_back(h);
+		w = (w+1)/2;
+		h = (h+1)/2;
+	}
+	files.assign(WEB_MIP_LEVELS, (FILE *)NULL);
+	pending.resize(WEB_MIP_LEVELS);
+	reduced.resize(WEB_MIP_LEVELS);
+	has_pending.assign(WEB_MIP_LEVELS, false);
+	min_term.assign(terms, FLT_MAX);
+	max_term.assign(terms, -FLT_MAX);
+}
+
+HshWebWriter::~HshWebWriter()
+{
+	for (int l=0; l<WEB_MIP_LEVELS; l++)
+		if (files[l])
+			fclose(files[l]);
+}
+
+bool HshWebWriter::open()
+{
+	for (int l=0; l<WEB_MIP_LEVELS; l++)
+	{
+		files[l] = tmpfile();
+		if (!files[l])
+			return false;
+		pending[l].resize((size_t)level_width[l]*samples);
+		if (l+1 < WEB_MIP_LEVELS)
+			reduced[l].resize((size_t)level_width[l+1]*samples);
+	}
+	return true;
+}
+
+/**
+ * Takes the next 'rows' rows of the image, a block of coefficients in [term][channel][pixel] order.
+ */
+bool HshWebWriter::add_rows(const float * result, int rows)
+{
+	size_t plane = (size_t)width*rows;
+	size_t image = plane*channels;
+	row_buffer.resize((size_t)width*samples);
+	
+	for (int r=0; r<rows; r++)
+	{
+		for (int t=0; t<terms; t++)
+		{
+			for (int c=0; c<channels; c++)
+			{
+				const float * float_ptr = &(result[image*t+plane*c+(size_t)r*width]);
+				float * out_ptr = &(row_buffer[c*terms+t]);
+				for (int x=0; x<width; x++)
+				{
+					float value = float_ptr[x];
+					if (value<min_term[t]) min_term[t] = value;
+					if (value>max_term[t]) max_term[t] = value;
+					out_ptr[(size_t)x*samples] = value;
+				}
+			}
+		}
+		push_row(0, &(row_buffer[0]));
+	}
+	return !failed;
+}
+
+/**
+ * Appends a row to mip level 'level'. Every second row is averaged with the previous one,
+ * two by two pixels like the viewer does, and the result goes to the next level.
+ */
+void HshWebWriter::push_row(int level, const float * row)
+{
+	size_t length = (size_t)level_width[level]*samples;
+	if (fwrite(row, sizeof(float), length, files[level]) != length)
+		failed = true;
+	spill_bytes += sizeof(float)*length;
+	
+	if (level+1 >= WEB_MIP_LEVELS)
+		return;
+	if (!has_pending[level])
+	{
+		memcpy(&(pending[level][0]), row, sizeof(float)*length);
+		has_pending[level] = true;
+		return;
+	}
+	
+	const float * above = &(pending[level][0]);
+	float * out = &(reduced[level][0]);
+	int w = level_width[level];
+	for (int x=0; x+1<w; x+=2)
+	{
+		const float * a = &(above[(size_t)x*samples]);
+		const float * b = &(row[(size_t)x*samples]);
+		float * o = &(out[(size_t)(x/2)*samples]);
+		for (int s=0; s<samples; s++)
+			o[s] = (a[s] + a[s+samples] + b[s] + b[s+samples])/4;
+	}
+	if (w%2)
+	{
+		const float * a = &(above[(size_t)(w-1)*samples]);
+		const float * b = &(row[(size_t)(w-1)*samples]);
+		float * o = &(out[(size_t)(w/2)*samples]);
+		for (int s=0; s<samples; s++)
+			o[s] = (a[s] + b[s])/2;
+	}
+	has_pending[level] = false;
+	push_row(level+1, out);
+}
+
+/**
+ * A level of odd height ends with an unpaired row, it becomes the last row of the next level
+ * on its own.
+ */
+void HshWebWriter::finish_levels()
+{
+	for (int l=0; l+1<WEB_MIP_LEVELS; l++)
+	{
+		if (!has_pending[l])
+			continue;
+		const float * row = &(pending[l][0]);
+		float * out = &(reduced[l][0]);
+		int w = level_width[l];
+		for (int x=0; x<w; x+=2)
+		{
+			const float * a = &(row[(size_t)x*samples]);
+			float * o = &(out[(size_t)(x/2)*samples]);
+			for (int s=0; s<samples; s++)
+				o[s] = (x+1<w) ? (a[s] + a[s+samples])/2 : a[s];
+		}
+		has_pending[l] = false;
+		push_row(l+1, out);
+	}
+}
+
+/**
+ * Z-order index of tile (row, col) of a 2^level x 2^level grid, as in rtiwebmaker.
+ */
+int HshWebWriter::z_index(int row, int col, int level)
+{
+	int index = 0;
+	for (int k=0; k<level; k++)
+	{
+		if (col & (1<<k))
+			index += 1<<(2*k);
+		if (row & (1<<k))
+			index += 1<<(2*k+1);
+	}
+	return index;
+}
+
+/**
+ * Reads pixels [x1, x2) of rows [y1, y2) of mip level 'level' into 'dest'.
+ */
+bool HshWebWriter::read_rows(int level, int x1, int y1, int x2, int y2, float * dest)
+{
+	size_t length = (size_t)(x2-x1)*samples;
+	bool ok = true;
+#pragma omp critical (hsh_web_read)
+	{
+		for (int y=y1; y<y2 && ok; y++)
+		{
+			double offset = ((double)y*level_width[level] + x1)*samples*sizeof(float);
+			ok = seek_file(files[level], offset) &&
+				 fread(dest + (size_t)(y-y1)*length, sizeof(float), length, files[level]) == length;
+		}
+	}
+	return ok;
+}
+
+/**
+ * Encodes the tile [x1, x2) x [y1, y2) of mip level 'level' like Hsh::saveCompressed : a lossless
+ * J2K codestream of 3*terms signed 16 bit grey components (the terms of red, green then blue,
+ * grey images repeat theirs) holding (value - bias)/scale*255.
+ */
+bool HshWebWriter::save_tile(const string & filename, int level, int x1, int y1, int x2, int y2, vector<float> & buffer)
+{
+	int tile_width = x2-x1, tile_height = y2-y1;
+	size_t pixels = (size_t)tile_width*tile_height;
+	buffer.resize(pixels*samples);
+	if (!read_rows(level, x1, y1, x2, y2, &(buffer[0])))
+		return false;
+	
+	opj_cparameters_t parameters;
+	opj_set_default_encoder_parameters(&parameters);
+	parameters.tcp_rates[0] = 0;
+	parameters.tcp_numlayers = 1;
+	parameters.cp_disto_alloc = 1;
+	
+	int numcomps = 3*terms;
+	parameters.tcp_mct = (numcomps == 3) ? 1 : 0;
+	
+	vector<opj_image_cmptparm_t> component(numcomps);
+	memset(&(component[0]), 0, numcomps*sizeof(opj_image_cmptparm_t));
+	for (int k=0; k<numcomps; k++)
+	{
+		component[k].prec = 16;
+		component[k].bpp = 16;
+		component[k].sgnd = 1;
+		component[k].dx = parameters.subsampling_dx;
+		component[k].dy = parameters.subsampling_dy;
+		component[k].w = tile_width;
+		component[k].h = tile_height;
+	}
+	opj_image_t * image = opj_image_create(numcomps, &(component[0]), CLRSPC_GRAY);
+	if (!image)
+		return false;
+	image->x0 = parameters.image_offset_x0;
+	image->y0 = parameters.image_offset_y0;
+	image->x1 = parameters.image_offset_x0 + (tile_width-1)*parameters.subsampling_dx + 1;
+	image->y1 = parameters.image_offset_y0 + (tile_height-1)*parameters.subsampling_dy + 1;
+	
+	for (int band=0; band<3; band++)
+	{
+		int c = min(band, channels-1);
+		for (int t=0; t<terms; t++)
+		{
+			float diff = max_term[t]-min_term[t];
+			float scale = (diff > 0) ? 255/diff : 0;
+			const float * float_ptr = &(buffer[c*terms+t]);
+			int * data = image->comps[band*terms+t].data;
+			for (size_t i=0; i<pixels; i++)
+				data[i] = (int)((float_ptr[i*samples]-min_term[t])*scale);
+		}
+	}
+	
+	opj_cinfo_t * cinfo = opj_create_compress(CODEC_J2K);
+	if (!cinfo)
+	{
+		opj_image_destroy(image);
+		return false;
+	}
+	cinfo->event_mgr = NULL;	// the handle is not zeroed, no messages
+	cinfo->client_data = NULL;
+	cinfo->jp2_handle = NULL;
+	cinfo->mj2_handle = NULL;
+	opj_setup_encoder(cinfo, &parameters, image);
+	opj_cio_t * cio = opj_cio_open((opj_common_ptr)cinfo, NULL, 0);
+	bool ok = opj_encode(cinfo, cio, image, NULL);
+	
+	if (ok)
+	{
+		int length = cio_tell(cio);
+		FILE * file = fopen(filename.c_str(), "wb");
+		ok = file && fwrite(cio->buffer, 1, length, file) == (size_t)length;
+		if (file)
+			ok = (fclose(file) == 0) && ok;
+		if (ok)
+		{
+#pragma omp atomic
+			bytes_written += length;
+		}
+	}
+	
+	opj_cio_close(cio);
+	opj_destroy_compress(cinfo);
+	opj_image_destroy(image);
+	return ok;
+}
+
+/**
+ * thumb.jpg, rendered from the mip level the viewer would pick for a WEB_THUMB_WIDTH pixel
+ * preview with the light straight above the object (Hsh::createPreview).
+ */
+bool HshWebWriter::save_thumbnail(const string & filename)
+{
+	int preview_width = WEB_THUMB_WIDTH;
+	int preview_height = (int)(preview_width*((float)height/(float)width));
+	int level = WEB_MIP_LEVELS-1;
+	for (int l=0; l<WEB_MIP_LEVELS; l++)
+	{
+		if (level_width[l] <= preview_width || level_height[l] <= preview_height)
+		{
+			if (level_width[l] < preview_width && level_height[l] < preview_height && l > 0)
+				l--;
+			level = l;
+			break;
+		}
+	}
+	
+	float weights[HSH_MAX_TERMS];
+	hsh_basis(0.0, 0.0, order, weights);
+	
+	FILE * file = fopen(filename.c_str(), "wb");
+	if (!file)
+		return false;
+	
+	struct jpeg_compress_struct cinfo;
+	struct jpeg_error_mgr jerr;
+	cinfo.err = jpeg_std_error(&jerr);
+	jpeg_create_compress(&cinfo);
+	jpeg_stdio_dest(&cinfo, file);
+	cinfo.image_width = level_width[level];
+	cinfo.image_height = level_height[level];
+	cinfo.input_components = 3;
+	cinfo.in_color_space = JCS_RGB;
+	jpeg_set_defaults(&cinfo);
+	jpeg_set_quality(&cinfo, 100, TRUE);
+	jpeg_start_compress(&cinfo, TRUE);
+	
+	int w = level_width[level];
+	vector<float> row((size_t)w*samples);
+	vector<JSAMPLE> pixels((size_t)w*3);
+	bool ok = true;
+	for (int y=0; y<level_height[level] && ok; y++)
+	{
+		ok = read_rows(level, 0, y, w, y+1, &(row[0]));
+		for (int x=0; x<w; x++)
+		{
+			for (int band=0; band<3; band++)
+			{
+				const float * a = &(row[(size_t)x*samples + min(band, channels-1)*terms]);
+				float value = 0;
+				for (int t=0; t<terms; t++)
+					value += a[t]*weights[t];
+				value *= 255;
+				pixels[x*3+band] = (JSAMPLE)min(max(value, 0.0f), 255.0f);
+			}
+		}
+		JSAMPROW rows[1] = { &(pixels[0]) };
+		jpeg_write_scanlines(&cinfo, rows, 1);
+	}
+	
+	jpeg_finish_compress(&cinfo);
+	jpeg_destroy_compress(&cinfo);
+	bytes_written += (double)ftell(file);
+	return (fclose(file) == 0) && ok;
+}
+
+/**
+ * The XML descriptor of Hsh::saveRemoteDescr, scale and bias are those of the #HSH1.2 file.
+ */
+bool HshWebWriter::save_descriptor(const string & filename)
+{
+	FILE * file = fopen(filename.c_str(), "w");
+	if (!file)
+		return false;
+	
+	fprintf(file, "<RemoteRTIInfo>\n");
+	fprintf(file, "  <Info type=\"HSH\" width=\"%d\" height=\"%d\" levels=\"%d\" ordlen=\"%d\" bands=\"3\"/>\n",
+			width, height, levels, terms);
+	fprintf(file, "  <ScaleInfo>");
+	for (int t=0; t<terms; t++)
+		fprintf(file, "%.10E ", max_term[t]-min_term[t]);
+	fprintf(file, "</ScaleInfo>\n  <BiasInfo>");
+	for (int t=0; t<terms; t++)
+		fprintf(file, "%.10E ", min_term[t]);
+	fprintf(file, "</BiasInfo>\n</RemoteRTIInfo>\n");
+	
+	bytes_written += (double)ftell(file);
+	return fclose(file) == 0;
+}
+
+/**
+ * Writes the descriptor 'name', the thumbnail and every tile to 'directory', which is created
+ * if needed. Tiles are encoded by up to 'threads' threads, as many as fit in 'memory' bytes.
+ */
+bool HshWebWriter::save(const string & directory, const string & name, int threads, double memory)
+{
+	finish_levels();
+	if (failed)
+		return false;
+	
+#if _WIN32
+	_mkdir(directory.c_str());
+#else
+	mkdir(directory.c_str(), 0755);
+#endif
+	
+	bool ok = save_descriptor(join_path(directory, name)) && save_thumbnail(join_path(directory, "thumb.jpg"));
+	
+	for (int k=1; k<=levels && ok; k++)
+	{
+		// tiles of the full image, as in rtiwebmaker, mapped to mip level 'levels - k'
+		int size = 1<<k;
+		int level = levels-k;
+		float delta_width = (float)width/(float)size;
+		float delta_height = (float)height/(float)size;
+		
+		// the encoder needs a few copies of a tile
+		double tile_bytes = 4.0*sizeof(float)*samples*(delta_width/(1<<level)+1)*(delta_height/(1<<level)+1);
+		int tile_threads = (int)max(1.0, min((double)threads, memory/tile_bytes));
+		
+		int failures = 0;
+#pragma omp parallel num_threads(tile_threads)
+		{
+			vector<float> buffer;
+#pragma omp for schedule(dynamic) reduction(+:failures)
+			for (int tile=0; tile<size*size; tile++)
+			{
+				int i = tile/size, j = tile%size;
+				int x1 = (int)(delta_width*j), y1 = (int)(delta_height*i);
+				int x2 = (int)(delta_width*(j+1)), y2 = (int)(delta_height*(i+1));
+				x1 >>= level;
+				y1 >>= level;
+				x2 = (x2 == width) ? level_width[level] : x2 >> level;
+				y2 = (y2 == height) ? level_height[level] : y2 >> level;
+				
+				char tile_name[64];
+				sprintf(tile_name, "tile_lvl%d_%d.dat", k, z_index(i, j, k));
+				if (!save_tile(join_path(directory, tile_name), level, x1, y1, x2, y2, buffer))
+					failures++;
+			}
+		}
+		ok = (failures == 0);
+	}
+	
+	return ok;
+}
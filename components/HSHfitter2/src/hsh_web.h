@@ -0,0 +1,79 @@
+/*  HSHFitter
+ *  Copyright (C) 2009-11 UC Santa Cruz and Cultural Heritage Imaging
+ *    
+ *  Portions Copyright (C) 2010-11 Univ. do Minho and Cultural Heritage Imaging
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 3 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _HSH_WEB_H
+#define	_HSH_WEB_H
+
+#include <stdio.h>
+#include <vector>
+#include <string>
+
+using namespace std;
+
+// multi-resolution output : the viewer keeps WEB_MIP_LEVELS mip levels of a remote image,
+// the thumbnail is about WEB_THUMB_WIDTH pixels wide
+#define WEB_MIP_LEVELS 4
+#define WEB_DEFAULT_LEVELS 3
+#define WEB_THUMB_WIDTH 400
+
+/**
+ * Writes the fitted coefficients in the layout of rtiwebmaker, for the remote viewer : a
+ * directory with the XML descriptor, thumb.jpg and tile_lvl<k>_<z>.dat for k = 1..levels,
+ * 4^k JPEG 2000 tiles in z-order, cut from mip level 'levels - k'.
+ *
+ * The blocks of the fit are given in order with add_rows, which builds the mip levels on
+ * the fly (a pending row per level) and keeps every level in a temporary file of floats.
+ * The tiles are quantized with the scale and bias of each term over the whole image, so they
+ * are only encoded by save, once every row is known, one tile at a time per thread.
+ */
+class HshWebWriter {
+public:
+	HshWebWriter(int width, int height, int channels, int order, int levels);
+	~HshWebWriter();
+
+	bool open();
+	bool add_rows(const float * result, int rows);
+	bool save(const string & directory, const string & name, int threads, double memory);
+
+	double spill_bytes;		// size of the mip levels kept in the temporary files
+	double bytes_written;	// size of the tiles, the thumbnail and the descriptor
+
+	static int z_index(int row, int col, int level);
+
+private:
+	void push_row(int level, const float * row);
+	void finish_levels();
+	bool read_rows(int level, int x1, int y1, int x2, int y2, float * dest);
+	bool save_tile(const string & filename, int level, int x1, int y1, int x2, int y2, vector<float> & buffer);
+	bool save_thumbnail(const string & filename);
+	bool save_descriptor(const string & filename);
+
+	int width, height, channels, order, terms, levels;
+	int samples;							// channels*terms floats per pixel, [channel][term]
+	vector<int> level_width, level_height;
+	vector<FILE *> files;					// [row][pixel][channel][term] floats of each mip level
+	vector<vector<float> > pending;			// first row of the next pair of each level
+	vector<vector<float> > reduced;			// row of the next level made from a pair
+	vector<bool> has_pending;
+	vector<float> row_buffer;
+	vector<float> min_term, max_term;
+	bool failed;
+};
+
+#endif	/* _HSH_WEB_H */
@@ -0,0 +1,322 @@
+/*  HSHFitter
+ *  Copyright (C) 2009-11 UC Santa Cruz and Cultural Heritage Imaging
+ *    
+ *  Portions Copyright (C) 2010-11 Univ. do Minho and Cultural Heritage Imaging
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 3 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * hshfit-bench : renders a synthetic light dome in memory (a bumpy Lambertian surface
+ * with a specular lobe), fits it with every mode of HshCore and reports the wall time of
+ * each stage and the RMS error of the written HSH against the rendered samples.
+ * Nothing is read from disk, so the numbers only depend on the BLAS build, the thread
+ * count and the output path.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <map>
+#include <omp.h>
+#include "input.h"
+#include "hsh_core.hpp"
+#include "hsh_basis.h"
+#include "image_memory.h"
+
+using namespace std;
+
+struct BenchMode {
+	const char * name;
+	bool row_by_row;
+	int block_rows;
+	bool compressed;
+};
+
+static const BenchMode bench_modes[] = {
+	{ "in-memory",          false, 0,  true  },
+	{ "in-memory float",    false, 0,  false },
+	{ "row-by-row",         true,  1,  true  },
+	{ "row-by-row float",   true,  1,  false },
+	{ "blocked",            true,  64, true  },
+	{ "blocked float",      true,  64, false }
+};
+
+// swallows the progress messages of the fitter while a mode is timed
+class NullBuffer : public streambuf {
+protected:
+	int overflow(int c) { return c; }
+};
+
+// the rendered images, by the file names given to the fitter
+struct BenchDome {
+	int width, height;
+	map<string, const unsigned short *> samples;
+};
+
+// image opener of the fitter : every lit image is read from the rendered dome
+static Image * open_dome_image(const string & filename, void * context)
+{
+	const BenchDome * dome = (const BenchDome *) context;
+	map<string, const unsigned short *>::const_iterator it = dome->samples.find(filename);
+	if (it == dome->samples.end())
+		return NULL;
+	return new MemoryImage(filename, it->second, dome->width, dome->height, 3);
+}
+
+/**
+ * Light directions spread over the dome : elevations between 15 and 80 degrees,
+ * azimuths advancing by the golden angle.
+ */
+static void make_lights(int lights, vector<double> & lx, vector<double> & ly, vector<double> & lz)
+{
+	lx.resize(lights);
+	ly.resize(lights);
+	lz.resize(lights);
+	for (int i=0; i<lights; i++)
+	{
+		double elevation = (15 + 65*(i + 0.5)/lights)*M_PI/180;
+		double azimuth = i*2.399963229728653;
+		lx[i] = cos(elevation)*cos(azimuth);
+		ly[i] = cos(elevation)*sin(azimuth);
+		lz[i] = sin(elevation);
+	}
+}
+
+/**
+ * Renders one 16-bit RGB image per light : albedo*max(0, n.l) plus a Blinn-Phong lobe,
+ * the normals come from a field of bumps and the albedo varies across the image.
+ */
+static void render_dome(int width, int height, const vector<double> & lx, const vector<double> & ly,
+						const vector<double> & lz, vector< vector<unsigned short> > & images)
+{
+	int lights = lx.size();
+	images.resize(lights);
+
+#pragma omp parallel for schedule(dynamic)
+	for (int i=0; i<lights; i++)
+	{
+		vector<unsigned short> & image = images[i];
+		image.resize((size_t)width*height*3);
+
+		double hx = lx[i], hy = ly[i], hz = lz[i] + 1;
+		double norm = sqrt(hx*hx + hy*hy + hz*hz);
+		hx /= norm; hy /= norm; hz /= norm;
+
+		for (int y=0; y<height; y++)
+		{
+			for (int x=0; x<width; x++)
+			{
+				double u = 2*M_PI*x/64.0, v = 2*M_PI*y/48.0;
+				double nx = -0.5*cos(u)*sin(v), ny = -0.5*sin(u)*cos(v), nz = 1;
+				norm = sqrt(nx*nx + ny*ny + nz*nz);
+				nx /= norm; ny /= norm; nz /= norm;
+
+				double diffuse = max(0.0, nx*lx[i] + ny*ly[i] + nz*lz[i]);
+				double specular = pow(max(0.0, nx*hx + ny*hy + nz*hz), 40);
+				double albedo[3] = { 0.3 + 0.4*x/width, 0.5, 0.3 + 0.4*y/height };
+
+				unsigned short * pixel = &image[((size_t)y*width + x)*3];
+				for (int c=0; c<3; c++)
+				{
+					double value = 0.75*albedo[c]*diffuse + 0.2*specular;
+					pixel[c] = (unsigned short)(min(value, 1.0)*65535 + 0.5);
+				}
+			}
+		}
+	}
+}
+
+/**
+ * Reads back an HSH written by HshCore and returns the RMS difference, in 8 bit levels,
+ * between the samples it predicts and the rendered ones (as normalized by the readers).
+ * Returns a negative value if the file can not be read.
+ */
+static double fit_error(const string & filename, int order, const vector<double> & lx, const vector<double> & ly,
+						const vector<double> & lz, const vector< vector<unsigned short> > & images)
+{
+	ifstream file(filename.c_str(), ios::binary);
+	string magic;
+	int basis_type, width, height, channels, terms, layout, element_size;
+	file >> magic >> basis_type >> width >> height >> channels >> terms >> layout >> element_size;
+	file.ignore(2); // "\r\n"
+	if (!file || terms != order*order || (element_size != 1 && element_size != 4))
+		return -1;
+
+	vector<float> scale(terms), bias(terms);
+	file.read((char *)&scale[0], sizeof(float)*terms);
+	file.read((char *)&bias[0], sizeof(float)*terms);
+
+	size_t values = (size_t)width*height*channels*terms;
+	vector<float> coefficients(values);
+	if (element_size == 1)
+	{
+		vector<unsigned char> bytes(values);
+		file.read((char *)&bytes[0], values);
+		for (size_t k=0; k<values; k++)
+			coefficients[k] = bytes[k]/255.0f*scale[k%terms] + bias[k%terms];
+	}
+	else
+	{
+		file.read((char *)&coefficients[0], sizeof(float)*values);
+		for (size_t k=0; k<values; k++)
+			coefficients[k] = coefficients[k]*scale[k%terms] + bias[k%terms];
+	}
+	if (!file)
+		return -1;
+
+	// the same light angles as HshCore::make_hsh_matrix
+	int lights = lx.size();
+	vector<float> weights(lights*HSH_MAX_TERMS);
+	for (int i=0; i<lights; i++)
+	{
+		double phi = atan2(ly[i], lx[i]);
+		if (phi<0) phi = 2*M_PI+phi;
+		hsh_basis(acos(lz[i]), phi, order, &weights[i*HSH_MAX_TERMS]);
+	}
+
+	double sum = 0;
+	long samples = (long)width*height*channels;
+#pragma omp parallel for schedule(static) reduction(+:sum)
+	for (long s=0; s<samples; s++)
+	{
+		const float * c = &coefficients[s*terms];
+		for (int i=0; i<lights; i++)
+		{
+			const float * w = &weights[i*HSH_MAX_TERMS];
+			float predicted = 0;
+			for (int t=0; t<terms; t++)
+				predicted += c[t]*w[t];
+			double measured = images[i][s]/65535.0 + 1/255.0;
+			sum += (predicted - measured)*(predicted - measured);
+		}
+	}
+	return 255*sqrt(sum/((double)samples*lights));
+}
+
+int main(int argc, char ** argv)
+{
+	int width = 1024, height = 768, lights = 50, order = 3, robust = 0;
+	int threads = omp_get_max_threads();
+	string output = "hshfit-bench.hsh";
+
+	for (int i=1; i<argc; i++)
+	{
+		if (strcmp(argv[i],"--width")==0 && i+1<argc)
+			width = atoi(argv[++i]);
+		else if (strcmp(argv[i],"--height")==0 && i+1<argc)
+			height = atoi(argv[++i]);
+		else if (strcmp(argv[i],"--lights")==0 && i+1<argc)
+			lights = atoi(argv[++i]);
+		else if (strcmp(argv[i],"--order")==0 && i+1<argc)
+			order = atoi(argv[++i]);
+		else if (strcmp(argv[i],"--threads")==0 && i+1<argc)
+			threads = atoi(argv[++i]);
+		else if (strcmp(argv[i],"--robust")==0 && i+1<argc)
+			robust = atoi(argv[++i]);
+		else if (strcmp(argv[i],"--output")==0 && i+1<argc)
+			output = argv[++i];
+		else
+		{
+			cout << "Usage : hshfit-bench [--width <pixels>] [--height <pixels>] [--lights <n>] [--order <n>]" << endl;
+			cout << "                     [--threads <n>] [--robust <n>] [--output <scratch hsh file>]" << endl;
+			return 1;
+		}
+	}
+
+	if (width < 1 || height < 1 || lights < order*order || order < 1 || order > HSH_MAX_ORDER || threads < 1)
+	{
+		cout << "Invalid parameters : the order must be between 1 and " << HSH_MAX_ORDER
+			 << " and there must be at least order*order lights" << endl;
+		return 1;
+	}
+
+	vector<double> lx, ly, lz;
+	vector< vector<unsigned short> > images;
+	make_lights(lights, lx, ly, lz);
+	render_dome(width, height, lx, ly, lz, images);
+
+	BenchDome dome;
+	dome.width = width;
+	dome.height = height;
+
+	Input * input = new Input("", "", "", "", order, false, (ofstream *) &cout);
+	input->set_image_opener(open_dome_image, &dome);
+	input->lit_images.resize(lights);
+	for (int i=0; i<lights; i++)
+	{
+		char name[64];
+		sprintf(name, "memory:light_%03d", i);
+		LitImage & lit = input->lit_images[i];
+		lit.used = true;
+		lit.lx = lx[i];
+		lit.ly = ly[i];
+		lit.lz = lz[i];
+		lit.scale_r = lit.scale_g = lit.scale_b = 1;
+		lit.filename = name;
+		dome.samples[name] = &images[i][0];
+	}
+	input->num_files = input->num_used = lights;
+	input->width = width;
+	input->fullheight = height;
+	input->channels = 3;
+	input->set_output_filename(output);
+	input->setMaxThreads(threads);
+	input->set_robust_iterations(robust);
+	input->set_auto_plan(false);
+
+	printf("hshfit-bench : %d x %d pixels, %d lights, order %d, %d threads%s\n\n",
+		   width, height, lights, order, threads, robust ? ", robust" : "");
+	printf("%-18s %8s", "mode", "total");
+	for (int s=0; s<STAGE_COUNT; s++)
+		printf(" %8s", hsh_stage_names[s]);
+	printf(" %10s %10s\n", "Mpixel/s", "RMS error");
+
+	NullBuffer null_buffer;
+	int modes = sizeof(bench_modes)/sizeof(bench_modes[0]);
+	for (int m=0; m<modes; m++)
+	{
+		const BenchMode & mode = bench_modes[m];
+		input->height = height;
+		input->set_row_by_row(mode.row_by_row);
+		input->set_block_rows(mode.block_rows);
+		input->set_compressed(mode.compressed);
+
+		HshCore core(input);
+		streambuf * console = cout.rdbuf(&null_buffer);
+		core.compute_loop();
+		cout.rdbuf(console);
+
+		double error = fit_error(output, order, lx, ly, lz, images);
+
+		printf("%-18s %8.3f", mode.name, core.total_time);
+		for (int s=0; s<STAGE_COUNT; s++)
+			printf(" %8.3f", core.stage_time[s]);
+		printf(" %10.2f ", (double)width*height/core.total_time/1e6);
+		if (error < 0)
+			printf("%10s\n", "unreadable");
+		else
+			printf("%10.3f\n", error);
+	}
+	printf("\nStage times are wall seconds, the row-by-row pipeline overlaps decode, fit and write.\n");
+	printf("RMS error is in 8 bit levels, against the rendered samples.\n");
+
+	remove(output.c_str());
+	delete input;
+
+	return 0;
+}
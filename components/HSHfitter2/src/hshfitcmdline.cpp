@@ -18,13 +18,244 @@
 
 #include <string.h>
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <algorithm>
 #include <stdlib.h>
 #include<omp.h>
 #include "input.h"
 #include "hsh_core.hpp"
+#include "hsh_cache.h"
+#include "hsh_basis.h"
 
 using namespace std;
 
+// batch mode : jobs below BATCH_SMALL_PIXELS pixels do not keep all the cores busy on their own,
+// they run concurrently with BATCH_SMALL_THREADS threads each, larger jobs run one at a time
+#define BATCH_SMALL_PIXELS 4000000
+#define BATCH_SMALL_THREADS 2
+
+/**
+ * One line of a batch manifest : "<lp file> <order> <output file> [<ptm file>]".
+ */
+struct BatchJob {
+	string lp_filename;
+	int order;
+	string output_filename;
+	string ptm_filename;
+	Input * input;
+	HshCore * core;
+	int threads;
+	bool ok;
+	string messages;	// output of the fit when it ran concurrently with others, printed once they are done
+};
+
+/**
+ * Sends the fit to 'outputfn', an HSH unless its name ends in .ptm, and also
+ * to the PTM 'ptmFilename' if it is not empty.
+ */
+static void set_outputs(Input * input, const string & outputfn, const string & ptmFilename, int ptmFormat)
+{
+	string hsh = outputfn, ptm = ptmFilename;
+	size_t length = outputfn.size();
+	if (length > 4 && (outputfn.compare(length-4, 4, ".ptm") == 0 || outputfn.compare(length-4, 4, ".PTM") == 0))
+	{
+		hsh = "";
+		ptm = outputfn;
+	}
+	input->set_output_filename(hsh);
+	if (!ptm.empty())
+		input->set_ptm_output(ptm, ptmFormat);
+}
+
+/**
+ * Directory part of 'path', "." if there is none.
+ */
+static string parent_directory(const string & path)
+{
+	size_t slash = path.find_last_of("/\\");
+	if (slash == string::npos)
+		return ".";
+	return path.substr(0, slash+1);
+}
+
+static bool larger_job(const BatchJob * a, const BatchJob * b)
+{
+	return (double)a->input->width*a->input->fullheight*a->input->num_used
+		 > (double)b->input->width*b->input->fullheight*b->input->num_used;
+}
+
+/**
+ * Fits every job of 'manifest_filename'. The large jobs run first, one at a time with
+ * 'maxThreads' threads, then the small ones run concurrently, largest first, sharing
+ * the threads and the memory limit. Fits of the same light dome and order share their
+ * basis matrices, which are also saved in 'basisCacheDir' (next to each .lp file when empty,
+ * nowhere if 'basisCache' is false). The other settings apply to every job.
+ * Returns the number of jobs that failed.
+ */
+static int run_batch(const string & manifest_filename, int maxThreads, bool compressed, int ptmFormat, double memLimit,
+					 int blockRows, int robustIterations, const string & statsFilename, double progressInterval,
+					 bool basisCache, const string & basisCacheDir)
+{
+	ifstream manifest(manifest_filename.c_str());
+	if (!manifest)
+	{
+		cout << "Unable to open the batch manifest " << manifest_filename << endl;
+		return 1;
+	}
+	
+	vector<BatchJob> jobs;
+	int failed = 0;
+	string line;
+	for (int line_number=1; getline(manifest, line); line_number++)
+	{
+		istringstream fields(line);
+		BatchJob job;
+		if (!(fields >> job.lp_filename) || job.lp_filename[0] == '#')
+			continue;
+		if (!(fields >> job.order >> job.output_filename) || job.order < 1 || job.order > HSH_MAX_ORDER)
+		{
+			cout << manifest_filename << ":" << line_number << " : expected <lp file> <order 1-"
+				 << HSH_MAX_ORDER << "> <output file> [<ptm file>]" << endl;
+			failed++;
+			continue;
+		}
+		fields >> job.ptm_filename;
+		job.input = NULL;
+		job.core = NULL;
+		job.threads = maxThreads;
+		job.ok = false;
+		jobs.push_back(job);
+	}
+	
+	HshBasisCache basis_cache;
+	vector<BatchJob *> large, small;
+	for (size_t j=0; j<jobs.size(); j++)
+	{
+		BatchJob & job = jobs[j];
+		cout << "Job " << j+1 << " : " << job.lp_filename << endl;
+		job.input = new Input("", "deprecated", job.lp_filename, "", job.order, true, (ofstream *) &cout);
+		if (!job.input->read_inputs2())
+		{
+			cout << "Problem while reading " << job.lp_filename << endl;
+			failed++;
+			continue;
+		}
+		job.input->set_compressed(compressed);
+		set_outputs(job.input, job.output_filename, job.ptm_filename, ptmFormat);
+		if (blockRows > 0)
+			job.input->set_block_rows(blockRows);
+		job.input->set_auto_plan(blockRows <= 0);
+		job.input->set_mem_limit(memLimit*1048576);
+		job.input->set_robust_iterations(robustIterations);
+		job.input->set_progress_interval(progressInterval);
+		if (basisCache)
+			job.input->set_basis_cache_dir(basisCacheDir.empty() ? parent_directory(job.lp_filename) : basisCacheDir);
+		job.core = new HshCore(job.input, &basis_cache);
+		
+		if ((double)job.input->width*job.input->fullheight < BATCH_SMALL_PIXELS)
+			small.push_back(&job);
+		else
+			large.push_back(&job);
+	}
+	
+	for (size_t j=0; j<large.size(); j++)
+	{
+		large[j]->input->setMaxThreads(maxThreads);
+		large[j]->ok = large[j]->core->compute_loop();
+	}
+	
+	if (!small.empty())
+	{
+		int concurrent = max(1, min((int)small.size(), maxThreads/BATCH_SMALL_THREADS));
+		int threads = max(1, maxThreads/concurrent);
+		double limit = (memLimit > 0 ? memLimit*1048576 : MEMORY_FRACTION*HshCore::available_memory()) / concurrent;
+		
+		cout << "Fitting " << small.size() << " small jobs, " << concurrent << " at a time with "
+			 << threads << " threads each" << endl;
+		
+		// largest first, so the last jobs to start are the shortest ones
+		sort(small.begin(), small.end(), larger_job);
+		for (size_t j=0; j<small.size(); j++)
+		{
+			small[j]->threads = threads;
+			small[j]->input->setMaxThreads(threads);
+			small[j]->input->set_mem_limit(limit);
+		}
+		
+		// jobs, pipeline stages and their parallel loops
+		omp_set_max_active_levels(3);
+		
+		// every fit writes to its own buffer, so their messages are not interleaved
+#pragma omp parallel for schedule(dynamic) num_threads(concurrent)
+		for (int j=0; j<(int)small.size(); j++)
+		{
+			ostringstream messages;
+			small[j]->core->output = &messages;
+			small[j]->ok = small[j]->core->compute_loop();
+			small[j]->core->output = &cout;
+			small[j]->messages = messages.str();
+		}
+		
+		for (size_t j=0; j<jobs.size(); j++)
+			if (!jobs[j].messages.empty())
+				cout << "Job " << j+1 << " : " << jobs[j].lp_filename << endl << jobs[j].messages;
+	}
+	
+	ofstream stats;
+	if (!statsFilename.empty())
+	{
+		stats.open(statsFilename.c_str());
+		if (stats)
+			stats << "[\n";
+		else
+			cout << "Unable to write the statistics to " << statsFilename << endl;
+	}
+	
+	bool first = true;
+	int done = 0;
+	for (size_t j=0; j<jobs.size(); j++)
+	{
+		BatchJob & job = jobs[j];
+		if (!job.core)
+			continue;
+		if (job.ok)
+		{
+			cout << "Job " << j+1 << " : " << job.output_filename << (job.ptm_filename.empty() ? "" : " ")
+				 << job.ptm_filename << " in " << job.core->total_time << " s with "
+				 << job.threads << " threads" << endl;
+			done++;
+			if (stats.is_open())
+			{
+				if (!first)
+					stats << ",\n";
+				job.core->write_stats(stats);
+				first = false;
+			}
+		}
+		else
+		{
+			cout << "Job " << j+1 << " : " << job.output_filename << " failed" << endl;
+			failed++;
+		}
+	}
+	
+	if (stats.is_open())
+		stats << "]\n";
+	
+	cout << "Batch : " << done << " jobs done, " << failed << " failed, basis reused "
+		 << basis_cache.hits << " times" << endl;
+	
+	for (size_t j=0; j<jobs.size(); j++)
+	{
+		delete jobs[j].core;
+		delete jobs[j].input;
+	}
+	
+	return failed;
+}
+
 int main(int argc, char** argv)
 {
 	/**
@@ -33,6 +264,19 @@ int main(int argc, char** argv)
 	 */
 	bool row_by_row = true;
 
+	/**
+	 * Let the fitter choose between the row based reader and the all in memory fit,
+	 * and the number of rows per block, from the memory limit.
+	 *
+	 */
+	bool auto_plan = true;
+
+	/**
+	 * Memory limit for the automatic choice in MB, 0 uses a share of the available memory.
+	 *
+	 */
+	double memLimit = 0;
+
 	/**
 	 * Generates compresssed output file.
 	 *
@@ -73,6 +317,141 @@ int main(int argc, char** argv)
 	 */
 	string outputfn;
 
+	/**
+	 * Number of scanlines fitted per pass by the row based reader.
+	 *
+	 */
+	int blockRows = 0;
+
+	/**
+	 * Maximum number of outlier rejection passes, 0 disables robust fitting.
+	 *
+	 */
+	int robustIterations = 0;
+
+	/**
+	 * Telemetry : JSON summary file and seconds between progress lines.
+	 *
+	 */
+	string statsFilename;
+	double progressInterval = 0;
+
+	/**
+	 * Manifest of the batch mode, one job per line.
+	 *
+	 */
+	string batchFilename;
+
+	/**
+	 * Directory of the saved HSH basis matrices, empty for the directory of the light positions.
+	 *
+	 */
+	bool basisCache = true;
+	string basisCacheDir;
+
+	/**
+	 * Additional PTM output and its format.
+	 *
+	 */
+	string ptmFilename;
+	int ptmFormat = PTM_LRGB;
+
+	/**
+	 * Tiles for the remote viewer and their number of resolution levels.
+	 *
+	 */
+	string webDir;
+	int webLevels = WEB_DEFAULT_LEVELS;
+
+	/**
+	 * Rotation of the images about their centre, read from an axis file, 0 for none.
+	 *
+	 */
+	double rectAngle = 0;
+
+	/**
+	 * Optional "--name value" switches can appear anywhere on the command line,
+	 * they are removed here so the positional forms below keep working.
+	 *
+	 */
+	int positional = 1;
+	for (int i=1; i<argc; i++)
+	{
+		if (strcmp(argv[i],"--block-rows")==0 && i+1<argc)
+		{
+			blockRows = atoi(argv[++i]);
+			if (blockRows < 1) {
+				cout << "Invalid number of block rows : " << blockRows << ". Using 1" << endl;
+				blockRows = 1;
+			}
+		}
+		else if (strcmp(argv[i],"--mem-limit")==0 && i+1<argc)
+		{
+			memLimit = atof(argv[++i]);
+			if (memLimit < 0)
+				memLimit = 0;
+		}
+		else if (strcmp(argv[i],"--stats")==0 && i+1<argc)
+			statsFilename = argv[++i];
+		else if (strcmp(argv[i],"--basis-cache")==0 && i+1<argc)
+			basisCacheDir = argv[++i];
+		else if (strcmp(argv[i],"--no-basis-cache")==0)
+			basisCache = false;
+		else if (strcmp(argv[i],"--ptm")==0 && i+1<argc)
+			ptmFilename = argv[++i];
+		else if (strcmp(argv[i],"--ptm-format")==0 && i+1<argc)
+		{
+			i++;
+			if (strcmp(argv[i],"rgb")==0 || strcmp(argv[i],"RGB")==0)
+				ptmFormat = PTM_RGB;
+			else if (strcmp(argv[i],"lrgb")==0 || strcmp(argv[i],"LRGB")==0)
+				ptmFormat = PTM_LRGB;
+			else
+				cout << "Unknown PTM format : " << argv[i] << ". Using LRGB" << endl;
+		}
+		else if (strcmp(argv[i],"--web")==0 && i+1<argc)
+			webDir = argv[++i];
+		else if (strcmp(argv[i],"--web-levels")==0 && i+1<argc)
+		{
+			webLevels = atoi(argv[++i]);
+			if (webLevels < 1 || webLevels > WEB_MIP_LEVELS) {
+				cout << "Invalid number of web levels : " << webLevels << ". Using " << WEB_DEFAULT_LEVELS << endl;
+				webLevels = WEB_DEFAULT_LEVELS;
+			}
+		}
+		else if (strcmp(argv[i],"--rectify")==0 && i+1<argc)
+		{
+			if (!ImageRectifier::read_axis_file(argv[++i], rectAngle)) {
+				cout << "Unable to read the axis file " << argv[i] << ". The images are not rectified" << endl;
+				rectAngle = 0;
+			}
+		}
+		else if (strcmp(argv[i],"--batch")==0 && i+1<argc)
+			batchFilename = argv[++i];
+		else if (strcmp(argv[i],"--progress")==0 && i+1<argc)
+			progressInterval = atof(argv[++i]);
+		else if (strcmp(argv[i],"--robust")==0 && i+1<argc)
+		{
+			robustIterations = atoi(argv[++i]);
+			if (robustIterations < 0)
+				robustIterations = 0;
+		}
+		else
+			argv[positional++] = argv[i];
+	}
+	argc = positional;
+
+	if (!batchFilename.empty() && argc <= 2)
+	{
+		maxThreads = (argc == 2) ? atoi(argv[1]) : omp_get_max_threads();
+		if (maxThreads < 1) {
+			cout << "Invalid number of threads : " << maxThreads << ". " <<
+					"Using " << omp_get_max_threads() << " threads" << endl;
+			maxThreads = omp_get_max_threads();
+		}
+		return run_batch(batchFilename, maxThreads, compressed, ptmFormat, memLimit, blockRows, robustIterations, statsFilename, progressInterval,
+						 basisCache, basisCacheDir) ? 1 : 0;
+	}
 
 	switch(argc){
 
@@ -101,15 +480,13 @@ int main(int argc, char** argv)
 			prefix = argv[2];
 			order = atoi(argv[3]);
 			//cout << "Order : " << order << endl;
-			if((order < 1)||(order > 3)){
-				cout << "Invalid Order. Values must be between 1 and 3" << endl;
-				return 1;
-			}
 			lamps_filename = argv[4];
 			color_correction_filename = argv[5];
+			outputfn = filepath + prefix + ".hsh";
 
 			maxThreads = omp_get_max_threads();
 
+			auto_plan = (strcmp(argv[6],"auto")==0);
 			if (strcmp(argv[6],"true")==0)
 				row_by_row = true;
 			else
@@ -127,13 +504,11 @@ int main(int argc, char** argv)
 				prefix = argv[2];
 				order = atoi(argv[3]);
 				//cout << "Order : " << order << endl;
-				if((order < 1)||(order > 3)){
-					cout << "Invalid Order. Values must be between 1 and 3" << endl;
-					return 1;
-				}
 				lamps_filename = argv[4];
 				color_correction_filename = argv[5];
+				outputfn = filepath + prefix + ".hsh";
 
+				auto_plan = (strcmp(argv[6],"auto")==0);
 				if (strcmp(argv[6],"true")==0)
 					row_by_row = true;
 				else
@@ -160,11 +535,35 @@ int main(int argc, char** argv)
 						 << "<use_row_based_reader> <compressed>" << endl;
 		         cout << "Usage : hshfitter <path> <prefix> <order> <light_positions_file> <color_correction_file> "
 		         						 << "<use_row_based_reader> <compressed> <MaxNumberOfThreads>" << endl;
+		         cout << "Usage : hshfitter --batch <manifest> [MaxNumberOfThreads]" << endl;
+		         cout << "    <use_row_based_reader> is true, false or auto" << endl;
+		         cout << "    every line of <manifest> is a job : <path_to_light_positions_file> <order> <output_file_name> [<ptm_file_name>]" << endl;
+		         cout << "    an <output_file_name> ending in .ptm gets a PTM instead of an HSH" << endl;
+		         cout << "Options : --block-rows <n>   use the row based reader with n rows per pass" << endl;
+		         cout << "          --mem-limit <MB>   memory limit for choosing the reader and the rows per pass (default "
+		              << (int)(MEMORY_FRACTION*100) << "% of the memory)" << endl;
+		         cout << "          --robust <n>       reject shadows and highlights, at most n refitting passes (default 0, off)" << endl;
+		         cout << "          --stats <file>     write timings, throughput, bytes and peak memory as JSON (an array in batch mode)" << endl;
+		         cout << "          --progress <s>     print a progress line every s seconds" << endl;
+		         cout << "          --basis-cache <dir> save and reuse the HSH basis of each light dome in dir" << endl;
+		         cout << "                             (default : the directory of the light positions file)" << endl;
+		         cout << "          --no-basis-cache   always compute the HSH basis" << endl;
+		         cout << "          --ptm <file>       also fit a PTM, from the same decoded images" << endl;
+		         cout << "          --ptm-format <f>   lrgb (default) or rgb" << endl;
+		         cout << "          --web <dir>        also write the tiles of the remote viewer (as rtiwebmaker) to dir" << endl;
+		         cout << "          --web-levels <n>   resolution levels of the tiles, 1 to " << WEB_MIP_LEVELS
+		              << " (default " << WEB_DEFAULT_LEVELS << ")" << endl;
+		         cout << "          --rectify <file>   rotate the images to the axis in file (x y z) while they are fitted" << endl;
 		         cout << "    Example 1 : ./hshfitter /home/matheus/snooker2/assembly-files/teste.lp 2 2 /home/matheus/Desktop/partilhaVB/snooker.hsh" << endl;
 		         cout << "    Example 2 : ./hshfitter /home/matheus/snookerPrabath/jpeg-exports/ snooker-test-1-_00 2 teste.lp nofile.txt true true" << endl;
 				 return 0;
 	}
 
+	if((order < 1)||(order > HSH_MAX_ORDER)){
+		cout << "Invalid Order. Values must be between 1 and " << HSH_MAX_ORDER << endl;
+		return 1;
+	}
+
 	Input * input = new Input(filepath, prefix, lamps_filename, color_correction_filename, order, row_by_row,(ofstream *) &cout);
 
 	/**
@@ -200,10 +599,34 @@ int main(int argc, char** argv)
 
 
 	input->set_compressed(compressed);
-	input->set_output_filename(outputfn);
+	set_outputs(input, outputfn, ptmFilename, ptmFormat);
+	if (!webDir.empty())
+		input->set_web_output(webDir, webLevels);
+	input->set_rectification(rectAngle);
 	input->setMaxThreads(maxThreads);
+	if (blockRows > 0) // an explicit block size implies the row based reader
+	{
+		auto_plan = false;
+		input->set_row_by_row(true);
+		input->set_block_rows(blockRows);
+	}
+	input->set_auto_plan(auto_plan);
+	input->set_mem_limit(memLimit*1048576);
+	input->set_robust_iterations(robustIterations);
+	input->set_stats_filename(statsFilename);
+	input->set_progress_interval(progressInterval);
+	if (basisCache)
+	{
+		if (!basisCacheDir.empty())
+			input->set_basis_cache_dir(basisCacheDir);
+		else if (argc >= 8)
+			input->set_basis_cache_dir(filepath.empty() ? "." : filepath);
+		else
+			input->set_basis_cache_dir(parent_directory(filepath));
+	}
 
 	HshCore * core = new HshCore(input);
-	core->compute_loop();
+	bool ok = core->compute_loop();
 	//cin >> order;
+	return ok ? 0 : 1;
 }
@@ -22,128 +22,146 @@
 #include  <istream>
 
 #include "image.h"
+#include "image_jpeg.h"
+#include "image_tiff.h"
+#include "image_pnm.h"
+#include "image_png.h"
 
 using namespace std;
 
 Image::Image(const string & str_path, int type) : imgPath(str_path), imgType(type){
-
+	imgWidth = 0;
+	imgHeight = 0;
+	imgNChannels = 0;
+	dataFloat = NULL;
+	rowData = NULL;
+	SetScales(1, 1, 1);
 }
 
-bool Image::LoadHeader(){
-	struct jpeg_decompress_struct cinfo;
-	struct jpeg_error_mgr jerr;
-
-	cinfo.err = jpeg_std_error(&jerr);
-	jpeg_create_decompress(&cinfo);
-
-	FILE * fp;
-	fp = fopen(imgPath.c_str(),"rb");
-	if(!fp) return false;
-
-	jpeg_stdio_src(&cinfo,fp);
-
-	jpeg_read_header(&cinfo,TRUE);
-
-	imgHeight = cinfo.image_height;
-	imgWidth = cinfo.image_width;
-	imgNChannels = cinfo.num_components;
-
-	jpeg_abort_decompress(&cinfo);
-return true;
-
+Image::~Image(){
+	free(dataFloat);
+	free(rowData);
 }
 
-bool Image::LoadImage(){
-	struct jpeg_decompress_struct cinfo;
-	struct jpeg_error_mgr jerr;
-
-	cinfo.err = jpeg_std_error(&jerr);
-	jpeg_create_decompress(&cinfo);
-
-	FILE * fp;
-	fp = fopen(imgPath.c_str(),"rb");
-	if(!fp) return false;
-
-	jpeg_stdio_src(&cinfo,fp);
-
-	jpeg_read_header(&cinfo,TRUE);
-
-	jpeg_start_decompress(&cinfo);
-
-	cout << "Output Components : " << cinfo.output_components << endl;
-
-	int row_stride = cinfo.output_width*cinfo.output_components;
-
-	JSAMPARRAY buffer = (*cinfo.mem->alloc_sarray)
-	      ((j_common_ptr) &cinfo, JPOOL_IMAGE,
-	       row_stride , (JDIMENSION) 1);
-
-	//data = (unsigned char *)malloc(cinfo.output_height * cinfo.output_width * cinfo.output_components);
-	dataFloat = (float *)malloc(sizeof(float) * cinfo.output_height * cinfo.output_width * cinfo.output_components);
-
-
-	while(cinfo.output_scanline < cinfo.output_height){
-		jpeg_read_scanlines(&cinfo,buffer,1);
-
-		for(int j = 0; j < row_stride; j++){
-			//data[cinfo.output_scanline*row_stride+j] = (*buffer)[j];
-			dataFloat[cinfo.output_scanline*row_stride+j] = ((*buffer)[j] + 1)/255.0;
-		}
+Image * Image::Create(const string & str_path){
+	unsigned char magic[4] = {0, 0, 0, 0};
 
+	FILE * fp = fopen(str_path.c_str(),"rb");
+	if(!fp) {
+		cout << "Error opening image " << str_path << endl;
+		return NULL;
 	}
-
-	jpeg_finish_decompress(&cinfo);
-
+	size_t got = fread(magic, 1, 4, fp);
 	fclose(fp);
 
-	jpeg_destroy_decompress(&cinfo);
-return true;
-
+	if (got >= 2 && magic[0] == 0xFF && magic[1] == 0xD8)
+		return new JpegImage(str_path);
+	if (got == 4 && ((magic[0] == 'I' && magic[1] == 'I' && magic[2] == 42 && magic[3] == 0) ||
+		(magic[0] == 'M' && magic[1] == 'M' && magic[2] == 0 && magic[3] == 42)))
+		return new TiffImage(str_path);
+	if (got >= 2 && magic[0] == 'P' && (magic[1] == '5' || magic[1] == '6'))
+		return new PnmImage(str_path);
+	if (got == 4 && magic[0] == 0x89 && magic[1] == 'P' && magic[2] == 'N' && magic[3] == 'G')
+		return new PngImage(str_path);
+
+	cout << "Unsupported image format " << str_path << endl;
+	return NULL;
 }
 
-bool Image::PrepareRowByRow(){
-	cinfo_r.err = jpeg_std_error(&jerr_r);
-	jpeg_create_decompress(&cinfo_r);
-
-	fp_r = fopen(imgPath.c_str(),"rb");
-	if(!fp_r) return false;
+/**
+ * Decodes the whole image as floats into 'dest' (or into dataFloat when 'dest' is NULL),
+ * one row at a time through the reader's row-by-row interface.
+ * The decoder and its buffers are released before returning.
+ */
+bool Image::LoadImage(float * dest, bool planar){
+	if (!PrepareRowByRow())
+		return false;
 
-	jpeg_stdio_src(&cinfo_r,fp_r);
+	size_t row_stride = (size_t)imgWidth*imgNChannels;
 
-	jpeg_read_header(&cinfo_r,TRUE);
+	if (!dest)
+	{
+		dataFloat = (float *)malloc(sizeof(float) * imgHeight * row_stride);
+		dest = dataFloat;
+	}
 
-	jpeg_start_decompress(&cinfo_r);
+	bool ok = true;
+	size_t plane = planar ? (size_t)imgWidth*imgHeight : 0;
+	for (int row = 0; row < imgHeight && ok; row++)
+		ok = LoadImageRowByRow(&dest[row*(planar ? imgWidth : row_stride)], plane);
 
-	row_stride_r = cinfo_r.output_width*cinfo_r.output_components;
+	DestroyRowByRow();
 
-	buffer_r = (*cinfo_r.mem->alloc_sarray)
-	      ((j_common_ptr) &cinfo_r, JPOOL_IMAGE,
-	       row_stride_r , (JDIMENSION) 1);
+return ok;
 
-	rowData = (float *)malloc(sizeof(float) * cinfo_r.output_width * cinfo_r.output_components);
-	return true;
 }
 
-bool Image::LoadImageRowByRow(){
+void Image::SetScales(double scale_r, double scale_g, double scale_b){
+	scales[0] = scale_r;
+	scales[1] = scale_g;
+	scales[2] = scale_b;
+	lut8.clear();
+}
 
-		jpeg_read_scanlines(&cinfo_r,buffer_r,1);
+double Image::ChannelScale(int channel){
+	if (imgNChannels == 1)
+		return (scales[0] + scales[1] + scales[2])/3;
+	return (channel < 3) ? scales[channel] : 1;
+}
 
-		for(int j = 0; j < row_stride_r; j++){
-			//data[cinfo.output_scanline*row_stride+j] = (*buffer)[j];
-			rowData[j] = ((*buffer_r)[j] + 1)/255.0;
-		}
+void Image::ConvertRow8(const unsigned char * src, float * dest, int count, size_t plane){
+	int n = imgNChannels;
 
-	return true;
+	if (lut8.empty())
+	{
+		lut8.resize(n*256);
+		for (int c = 0; c < n; c++)
+			for (int v = 0; v < 256; v++)
+				lut8[c*256+v] = ((v + 1)/255.0)*ChannelScale(c);
+	}
 
+	const float * lut = &lut8[0];
+	if (n == 1)
+	{
+		for(int j = 0; j < count; j++)
+			dest[j] = lut[src[j]];
+		return;
+	}
+	if (plane)
+	{
+		for (int c = 0; c < n; c++)
+		{
+			float * channel = &dest[c*plane];
+			const float * channel_lut = &lut[c*256];
+			for(int j = c, x = 0; j < count; j += n, x++)
+				channel[x] = channel_lut[src[j]];
+		}
+		return;
+	}
+	for(int j = 0; j < count; j += n)
+		for (int c = 0; c < n; c++)
+			dest[j+c] = lut[c*256 + src[j+c]];
 }
 
-bool Image::DestroyRowByRow(){
-	jpeg_finish_decompress(&cinfo_r);
-
-	fclose(fp_r);
-
-	jpeg_destroy_decompress(&cinfo_r);
+/**
+ * Deeper samples are mapped onto the same scale as the 8-bit ones, v/maxval + 1/255,
+ * so a 16-bit capture and its 8-bit conversion fit to the same coefficients.
+ */
+void Image::ConvertRow16(const unsigned short * src, float * dest, int count, int maxval, size_t plane){
+	int n = imgNChannels;
+	double a[4], b[4];
+	for (int c = 0; c < n && c < 4; c++)
+	{
+		a[c] = ChannelScale(c)/maxval;
+		b[c] = ChannelScale(c)/255.0;
+	}
 
-	return true;
+	// planar output : sample j of channel c goes to dest[c*plane + j/n] instead of dest[j]
+	size_t pixel_step = plane ? 1 : n;
+	for (int c = 0; c < n; c++)
+	{
+		float * channel = plane ? &dest[c*plane] : &dest[c];
+		for(int j = c; j < count; j += n, channel += pixel_step)
+			*channel = src[j]*a[c] + b[c];
+	}
 }
-
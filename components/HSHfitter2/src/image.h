@@ -21,26 +21,50 @@
 
 #include <string>
 #include <string.h>
-
-extern "C"{
-    #include "jpeglib.h"
-}
-
+#include <stdio.h>
+#include <vector>
 
 using namespace std;
 
+#define IMAGE_JPEG 0
+#define IMAGE_TIFF 1
+#define IMAGE_PNM 2
+#define IMAGE_MEMORY 3
+#define IMAGE_PNG 4
+
+/*
+ * Row-streaming image reader. The fitter only ever asks for the header, the whole
+ * image or the next row, always as floats normalized like the original libjpeg loader
+ * ((v+1)/255 for 8-bit samples), so every format is a subclass implementing those calls.
+ * Use Image::Create to get the reader matching a file. The per-channel colour correction
+ * of the light is applied by the same conversion, so it costs nothing at fit time.
+ */
 class Image {
 public:
     Image(const string & str_path,int type);
-    ~Image(){};
+    virtual ~Image();
+
+    /**
+     * Returns the reader for the file, chosen from its signature, or NULL if it cannot be read.
+     */
+    static Image * Create(const string & str_path);
+
+    virtual bool LoadHeader() = 0;
+    /** Decodes the whole image, as [channel][row][column] planes when 'planar' is set. */
+    virtual bool LoadImage(float * dest = NULL, bool planar = false);
 
-    bool LoadHeader();
-    bool LoadImage();
+    /**
+     * Decodes the next row into 'dest' (or into rowData when 'dest' is NULL). The samples are
+     * pixel-interleaved when 'plane' is 0, otherwise every channel goes to its own plane
+     * and 'plane' is the distance between the planes.
+     */
+    virtual bool LoadImageRowByRow(float * dest = NULL, size_t plane = 0) = 0;
 
-    bool LoadImageRowByRow();
+    virtual bool PrepareRowByRow() = 0;
+    virtual bool DestroyRowByRow() = 0;
 
-    bool PrepareRowByRow();
-    bool DestroyRowByRow();
+    /** Colour correction multiplied into the samples, grey images use the mean of the three */
+    void SetScales(double scale_r, double scale_g, double scale_b);
 
     int imgWidth;
     int imgHeight;
@@ -48,24 +72,19 @@ public:
     int imgType;
     string imgPath;
 
-    unsigned char * data;
-
     float * dataFloat;
 
     float * rowData;
 
-    struct jpeg_decompress_struct cinfo_r;
-    struct jpeg_error_mgr jerr_r;
-
-    FILE * fp_r;
+protected:
+    double ChannelScale(int channel);
+    void ConvertRow8(const unsigned char * src, float * dest, int count, size_t plane);
+    void ConvertRow16(const unsigned short * src, float * dest, int count, int maxval, size_t plane);
 
-    int row_stride_r;
+    double scales[3];
 
-    JSAMPARRAY buffer; //All image
-
-    JSAMPARRAY buffer_r; //Image row by row
+    vector<float> lut8; // [channel][value] for 8-bit samples, built on the first row
 
 };
 
 #endif	/* _IMAGE_H */
-
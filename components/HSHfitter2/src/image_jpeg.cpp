@@ -0,0 +1,118 @@
+/*  HSHFitter
+ *  Copyright (C) 2009-11 UC Santa Cruz and Cultural Heritage Imaging
+ *    
+ *  Portions Copyright (C) 2010-11 Univ. do Minho and Cultural Heritage Imaging
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 3 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <iostream>
+
+#include "image_jpeg.h"
+
+using namespace std;
+
+JpegImage::JpegImage(const string & str_path) : Image(str_path, IMAGE_JPEG){
+	fp_r = NULL;
+}
+
+bool JpegImage::LoadHeader(){
+	struct jpeg_decompress_struct cinfo;
+	struct jpeg_error_mgr jerr;
+
+	cinfo.err = jpeg_std_error(&jerr);
+	jpeg_create_decompress(&cinfo);
+
+	FILE * fp;
+	fp = fopen(imgPath.c_str(),"rb");
+	if(!fp) {
+		jpeg_destroy_decompress(&cinfo);
+		return false;
+	}
+
+	jpeg_stdio_src(&cinfo,fp);
+
+	jpeg_read_header(&cinfo,TRUE);
+
+	imgHeight = cinfo.image_height;
+	imgWidth = cinfo.image_width;
+	imgNChannels = cinfo.num_components;
+
+	jpeg_destroy_decompress(&cinfo);
+	fclose(fp);
+return true;
+
+}
+
+bool JpegImage::PrepareRowByRow(){
+	cinfo_r.err = jpeg_std_error(&jerr_r);
+	jpeg_create_decompress(&cinfo_r);
+
+	fp_r = fopen(imgPath.c_str(),"rb");
+	if(!fp_r) {
+		jpeg_destroy_decompress(&cinfo_r);
+		return false;
+	}
+
+	jpeg_stdio_src(&cinfo_r,fp_r);
+
+	jpeg_read_header(&cinfo_r,TRUE);
+
+	jpeg_start_decompress(&cinfo_r);
+
+	imgHeight = cinfo_r.output_height;
+	imgWidth = cinfo_r.output_width;
+	imgNChannels = cinfo_r.output_components;
+
+	row_stride_r = cinfo_r.output_width*cinfo_r.output_components;
+
+	buffer_r = (*cinfo_r.mem->alloc_sarray)
+	      ((j_common_ptr) &cinfo_r, JPOOL_IMAGE,
+	       row_stride_r , (JDIMENSION) 1);
+
+	rowData = (float *)realloc(rowData, sizeof(float) * row_stride_r);
+	return true;
+}
+
+bool JpegImage::LoadImageRowByRow(float * dest, size_t plane){
+
+		if (!dest)
+			dest = rowData;
+
+		if (jpeg_read_scanlines(&cinfo_r,buffer_r,1) != 1)
+			return false;
+
+		ConvertRow8(*buffer_r, dest, row_stride_r, plane);
+
+	return true;
+
+}
+
+bool JpegImage::DestroyRowByRow(){
+	if (!fp_r)
+		return false;
+
+	if (cinfo_r.output_scanline < cinfo_r.output_height)
+		jpeg_abort_decompress(&cinfo_r);
+	else
+		jpeg_finish_decompress(&cinfo_r);
+
+	fclose(fp_r);
+	fp_r = NULL;
+
+	jpeg_destroy_decompress(&cinfo_r);
+
+	return true;
+}
@@ -0,0 +1,54 @@
+/*  HSHFitter
+ *  Copyright (C) 2009-11 UC Santa Cruz and Cultural Heritage Imaging
+ *    
+ *  Portions Copyright (C) 2010-11 Univ. do Minho and Cultural Heritage Imaging
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 3 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _IMAGE_JPEG_H
+#define	_IMAGE_JPEG_H
+
+#include "image.h"
+
+extern "C"{
+    #include "jpeglib.h"
+}
+
+/*
+ * libjpeg reader.
+ */
+class JpegImage : public Image {
+public:
+    JpegImage(const string & str_path);
+
+    bool LoadHeader();
+
+    bool LoadImageRowByRow(float * dest = NULL, size_t plane = 0);
+
+    bool PrepareRowByRow();
+    bool DestroyRowByRow();
+
+private:
+    struct jpeg_decompress_struct cinfo_r;
+    struct jpeg_error_mgr jerr_r;
+
+    FILE * fp_r;
+
+    int row_stride_r;
+
+    JSAMPARRAY buffer_r; //Image row by row
+
+};
+
+#endif	/* _IMAGE_JPEG_H */
@@ -0,0 +1,69 @@
+/*  HSHFitter
+ *  Copyright (C) 2009-11 UC Santa Cruz and Cultural Heritage Imaging
+ *    
+ *  Portions Copyright (C) 2010-11 Univ. do Minho and Cultural Heritage Imaging
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 3 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+
+#include "image_memory.h"
+
+using namespace std;
+
+MemoryImage::MemoryImage(const string & name, const unsigned short * samples, int width, int height, int channels)
+	: Image(name, IMAGE_MEMORY), samples(samples), width(width), height(height), channels(channels){
+	row_r = 0;
+}
+
+bool MemoryImage::LoadHeader(){
+	if (!samples)
+		return false;
+
+	imgWidth = width;
+	imgHeight = height;
+	imgNChannels = channels;
+return true;
+
+}
+
+bool MemoryImage::PrepareRowByRow(){
+	if (!LoadHeader())
+		return false;
+
+	row_r = 0;
+	rowData = (float *)realloc(rowData, sizeof(float) * imgWidth * imgNChannels);
+	return true;
+}
+
+bool MemoryImage::LoadImageRowByRow(float * dest, size_t plane){
+
+	if (!dest)
+		dest = rowData;
+
+	if (row_r >= imgHeight)
+		return false;
+
+	int row_stride = imgWidth*imgNChannels;
+	ConvertRow16(&samples[(size_t)row_r*row_stride], dest, row_stride, 65535, plane);
+	row_r++;
+
+	return true;
+
+}
+
+bool MemoryImage::DestroyRowByRow(){
+	row_r = 0;
+	return true;
+}
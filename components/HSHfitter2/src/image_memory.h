@@ -0,0 +1,48 @@
+/*  HSHFitter
+ *  Copyright (C) 2009-11 UC Santa Cruz and Cultural Heritage Imaging
+ *    
+ *  Portions Copyright (C) 2010-11 Univ. do Minho and Cultural Heritage Imaging
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 3 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _IMAGE_MEMORY_H
+#define	_IMAGE_MEMORY_H
+
+#include "image.h"
+
+/*
+ * Reader for 16-bit, pixel-interleaved images that are already in memory. hshfit-bench
+ * hands these to the fitter through Input::set_image_opener to fit synthetic light domes
+ * without any file I/O. The samples are not copied and must outlive the reader.
+ */
+class MemoryImage : public Image {
+public:
+    MemoryImage(const string & name, const unsigned short * samples, int width, int height, int channels);
+
+    bool LoadHeader();
+
+    bool LoadImageRowByRow(float * dest = NULL, size_t plane = 0);
+
+    bool PrepareRowByRow();
+    bool DestroyRowByRow();
+
+private:
+    const unsigned short * samples;
+    int width, height, channels;
+
+    int row_r;
+
+};
+
+#endif	/* _IMAGE_MEMORY_H */
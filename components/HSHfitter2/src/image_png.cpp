@@ -0,0 +1,196 @@
+/*  HSHFitter
+ *  Copyright (C) 2009-11 UC Santa Cruz and Cultural Heritage Imaging
+ *    
+ *  Portions Copyright (C) 2010-11 Univ. do Minho and Cultural Heritage Imaging
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 3 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <iostream>
+
+#include "image_png.h"
+
+using namespace std;
+
+PngImage::PngImage(const string & str_path) : Image(str_path, IMAGE_PNG){
+	bit_depth = 8;
+	fp_r = NULL;
+	png_r = NULL;
+	info_r = NULL;
+	row_r = 0;
+	row_bytes_r = 0;
+	rows_r = NULL;
+	interlaced_r = false;
+}
+
+PngImage::~PngImage(){
+	DestroyRowByRow();
+}
+
+/**
+ * Reads the header and sets the transformations, the caller has set the error jump of 'png'.
+ */
+bool PngImage::ReadHeader(png_structp png, png_infop info){
+	png_read_info(png, info);
+
+	int color_type = png_get_color_type(png, info);
+
+	if (color_type == PNG_COLOR_TYPE_PALETTE)
+		png_set_palette_to_rgb(png);
+	if (color_type == PNG_COLOR_TYPE_GRAY && png_get_bit_depth(png, info) < 8)
+		png_set_expand_gray_1_2_4_to_8(png);
+	if (color_type & PNG_COLOR_MASK_ALPHA)
+		png_set_strip_alpha(png);
+	png_set_interlace_handling(png);
+
+	png_read_update_info(png, info);
+
+	imgWidth = png_get_image_width(png, info);
+	imgHeight = png_get_image_height(png, info);
+	imgNChannels = png_get_channels(png, info);
+	bit_depth = png_get_bit_depth(png, info);
+
+	if (imgWidth <= 0 || imgHeight <= 0 || (imgNChannels != 1 && imgNChannels != 3))
+	{
+		cout << "Invalid PNG header " << imgPath << endl;
+		return false;
+	}
+	return true;
+}
+
+bool PngImage::LoadHeader(){
+	FILE * fp = fopen(imgPath.c_str(),"rb");
+	if(!fp) return false;
+
+	png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	png_infop info = png ? png_create_info_struct(png) : NULL;
+	if (!info || setjmp(png_jmpbuf(png)))
+	{
+		png_destroy_read_struct(&png, &info, NULL);
+		fclose(fp);
+		return false;
+	}
+
+	png_init_io(png, fp);
+	bool ok = ReadHeader(png, info);
+
+	png_destroy_read_struct(&png, &info, NULL);
+	fclose(fp);
+return ok;
+
+}
+
+bool PngImage::PrepareRowByRow(){
+	fp_r = fopen(imgPath.c_str(),"rb");
+	if(!fp_r) return false;
+
+	png_r = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	info_r = png_r ? png_create_info_struct(png_r) : NULL;
+	if (!info_r || setjmp(png_jmpbuf(png_r)))
+	{
+		DestroyRowByRow();
+		return false;
+	}
+
+	png_init_io(png_r, fp_r);
+	if (!ReadHeader(png_r, info_r))
+	{
+		DestroyRowByRow();
+		return false;
+	}
+
+	// 16-bit samples are big-endian in the file
+	if (bit_depth == 16)
+		png_set_swap(png_r);
+
+	row_r = 0;
+	row_bytes_r = png_get_rowbytes(png_r, info_r);
+	interlaced_r = png_get_interlace_type(png_r, info_r) != PNG_INTERLACE_NONE;
+	rows_r = (png_bytep)malloc(row_bytes_r * (interlaced_r ? imgHeight : 1));
+	if (!rows_r)
+	{
+		DestroyRowByRow();
+		return false;
+	}
+
+	if (interlaced_r)
+	{
+		// malloc'd rather than a vector, libpng errors longjmp past destructors
+		png_bytepp rows = (png_bytepp)malloc(sizeof(png_bytep) * imgHeight);
+		if (!rows)
+		{
+			DestroyRowByRow();
+			return false;
+		}
+		for (int y = 0; y < imgHeight; y++)
+			rows[y] = rows_r + (size_t)y*row_bytes_r;
+		if (setjmp(png_jmpbuf(png_r)))
+		{
+			free(rows);
+			DestroyRowByRow();
+			return false;
+		}
+		png_read_image(png_r, rows);
+		free(rows);
+	}
+
+	rowData = (float *)realloc(rowData, sizeof(float) * imgWidth * imgNChannels);
+	return true;
+}
+
+bool PngImage::LoadImageRowByRow(float * dest, size_t plane){
+
+	if (!dest)
+		dest = rowData;
+
+	if (!png_r || row_r >= imgHeight)
+		return false;
+
+	png_bytep row = rows_r;
+	if (interlaced_r)
+		row += (size_t)row_r*row_bytes_r;
+	else
+	{
+		if (setjmp(png_jmpbuf(png_r)))
+			return false;
+		png_read_row(png_r, row, NULL);
+	}
+	row_r++;
+
+	int samples = imgWidth*imgNChannels;
+	if (bit_depth == 16)
+		ConvertRow16((const unsigned short *)row, dest, samples, 65535, plane);
+	else
+		ConvertRow8(row, dest, samples, plane);
+
+	return true;
+
+}
+
+bool PngImage::DestroyRowByRow(){
+	if (png_r)
+		png_destroy_read_struct(&png_r, info_r ? &info_r : NULL, NULL);
+	png_r = NULL;
+	info_r = NULL;
+
+	if (fp_r)
+		fclose(fp_r);
+	fp_r = NULL;
+
+	free(rows_r);
+	rows_r = NULL;
+
+	return true;
+}
@@ -0,0 +1,67 @@
+/*  HSHFitter
+ *  Copyright (C) 2009-11 UC Santa Cruz and Cultural Heritage Imaging
+ *    
+ *  Portions Copyright (C) 2010-11 Univ. do Minho and Cultural Heritage Imaging
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 3 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _IMAGE_PNG_H
+#define	_IMAGE_PNG_H
+
+#include <setjmp.h>
+
+#include "image.h"
+
+extern "C"{
+    #include "png.h"
+}
+
+/*
+ * libpng reader, 8 or 16 bits per sample. Palettes and grey levels under 8 bits are
+ * expanded and the alpha channel is dropped. Interlaced images cannot be streamed, they
+ * are decoded whole by PrepareRowByRow and handed out row by row.
+ */
+class PngImage : public Image {
+public:
+    PngImage(const string & str_path);
+    ~PngImage();
+
+    bool LoadHeader();
+
+    bool LoadImageRowByRow(float * dest = NULL, size_t plane = 0);
+
+    bool PrepareRowByRow();
+    bool DestroyRowByRow();
+
+private:
+    bool ReadHeader(png_structp png, png_infop info);
+
+    int bit_depth;
+
+    FILE * fp_r;
+
+    png_structp png_r;
+    png_infop info_r;
+
+    int row_r;
+
+    size_t row_bytes_r;
+
+    png_bytep rows_r; // one row, or the whole image when it is interlaced
+
+    bool interlaced_r;
+
+};
+
+#endif	/* _IMAGE_PNG_H */
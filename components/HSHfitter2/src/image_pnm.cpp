@@ -0,0 +1,163 @@
+/*  HSHFitter
+ *  Copyright (C) 2009-11 UC Santa Cruz and Cultural Heritage Imaging
+ *    
+ *  Portions Copyright (C) 2010-11 Univ. do Minho and Cultural Heritage Imaging
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 3 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <iostream>
+
+#include "image_pnm.h"
+
+using namespace std;
+
+PnmImage::PnmImage(const string & str_path) : Image(str_path, IMAGE_PNM){
+	maxval = 255;
+	fp_r = NULL;
+	raw_r = NULL;
+	samples_r = NULL;
+}
+
+PnmImage::~PnmImage(){
+	DestroyRowByRow();
+}
+
+/* Reads the next header number, skipping whitespace and '#' comments */
+static int read_pnm_value(FILE * fp)
+{
+	int c = fgetc(fp);
+	while (c != EOF && (isspace(c) || c == '#'))
+	{
+		if (c == '#')
+			while (c != EOF && c != '\n')
+				c = fgetc(fp);
+		c = fgetc(fp);
+	}
+
+	int value = -1;
+	while (c != EOF && isdigit(c))
+	{
+		value = ((value < 0) ? 0 : value*10) + (c - '0');
+		c = fgetc(fp);
+	}
+	// the single whitespace character after the last header value is consumed here
+	return value;
+}
+
+/**
+ * Parses the header and leaves 'fp' on the first sample.
+ */
+bool PnmImage::ReadHeader(FILE * fp){
+	char magic[2];
+	if (fread(magic, 1, 2, fp) != 2 || magic[0] != 'P' || (magic[1] != '5' && magic[1] != '6'))
+	{
+		cout << "Not a binary PGM/PPM image " << imgPath << endl;
+		return false;
+	}
+
+	imgNChannels = (magic[1] == '5') ? 1 : 3;
+	imgWidth = read_pnm_value(fp);
+	imgHeight = read_pnm_value(fp);
+	maxval = read_pnm_value(fp);
+
+	if (imgWidth <= 0 || imgHeight <= 0 || maxval <= 0 || maxval > 65535)
+	{
+		cout << "Invalid PGM/PPM header " << imgPath << endl;
+		return false;
+	}
+	return true;
+}
+
+bool PnmImage::LoadHeader(){
+	FILE * fp = fopen(imgPath.c_str(),"rb");
+	if(!fp) return false;
+
+	bool ok = ReadHeader(fp);
+
+	fclose(fp);
+return ok;
+
+}
+
+bool PnmImage::PrepareRowByRow(){
+	fp_r = fopen(imgPath.c_str(),"rb");
+	if(!fp_r) return false;
+
+	if (!ReadHeader(fp_r))
+	{
+		fclose(fp_r);
+		fp_r = NULL;
+		return false;
+	}
+
+	int samples = imgWidth*imgNChannels;
+	int bytes = (maxval > 255) ? 2 : 1;
+
+	raw_r = (unsigned char *)malloc(samples*bytes);
+	if (maxval != 255)
+		samples_r = (unsigned short *)malloc(sizeof(unsigned short) * samples);
+
+	rowData = (float *)realloc(rowData, sizeof(float) * samples);
+	return true;
+}
+
+bool PnmImage::LoadImageRowByRow(float * dest, size_t plane){
+
+	if (!dest)
+		dest = rowData;
+
+	int samples = imgWidth*imgNChannels;
+
+	if (maxval <= 255)
+	{
+		if (fread(raw_r, 1, samples, fp_r) != (size_t)samples)
+			return false;
+		if (maxval == 255)
+			ConvertRow8(raw_r, dest, samples, plane);
+		else
+		{
+			for (int j = 0; j < samples; j++)
+				samples_r[j] = raw_r[j];
+			ConvertRow16(samples_r, dest, samples, maxval, plane);
+		}
+		return true;
+	}
+
+	if (fread(raw_r, 2, samples, fp_r) != (size_t)samples)
+		return false;
+
+	for (int j = 0; j < samples; j++)
+		samples_r[j] = (raw_r[2*j] << 8) | raw_r[2*j+1];
+
+	ConvertRow16(samples_r, dest, samples, maxval, plane);
+
+	return true;
+
+}
+
+bool PnmImage::DestroyRowByRow(){
+	if (fp_r)
+		fclose(fp_r);
+	fp_r = NULL;
+
+	free(raw_r);
+	raw_r = NULL;
+	free(samples_r);
+	samples_r = NULL;
+
+	return true;
+}
@@ -0,0 +1,53 @@
+/*  HSHFitter
+ *  Copyright (C) 2009-11 UC Santa Cruz and Cultural Heritage Imaging
+ *    
+ *  Portions Copyright (C) 2010-11 Univ. do Minho and Cultural Heritage Imaging
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 3 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _IMAGE_PNM_H
+#define	_IMAGE_PNM_H
+
+#include "image.h"
+
+/*
+ * Binary PGM (P5) and PPM (P6) reader, 8 or 16 bits per sample (maxval > 255,
+ * big-endian as the format mandates). The rows are read straight from the file.
+ */
+class PnmImage : public Image {
+public:
+    PnmImage(const string & str_path);
+    ~PnmImage();
+
+    bool LoadHeader();
+
+    bool LoadImageRowByRow(float * dest = NULL, size_t plane = 0);
+
+    bool PrepareRowByRow();
+    bool DestroyRowByRow();
+
+private:
+    bool ReadHeader(FILE * fp);
+
+    int maxval;
+
+    FILE * fp_r;
+
+    unsigned char * raw_r;
+
+    unsigned short * samples_r;
+
+};
+
+#endif	/* _IMAGE_PNM_H */
@@ -0,0 +1,434 @@
+/*  HSHFitter
+ *  Copyright (C) 2009-11 UC Santa Cruz and Cultural Heritage Imaging
+ *    
+ *  Portions Copyright (C) 2010-11 Univ. do Minho and Cultural Heritage Imaging
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 3 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <iostream>
+#include <algorithm>
+
+#include "image_tiff.h"
+
+using namespace std;
+
+#define TIFF_LZW_CLEAR 256
+#define TIFF_LZW_EOI 257
+#define TIFF_LZW_FIRST 258
+#define TIFF_LZW_MAX_BITS 12
+#define TIFF_LZW_INPUT_BYTES 65536
+
+/*
+ * Streaming decoder for TIFF's LZW flavour (MSB-first codes, code width growing one
+ * code early). The strip is decoded on demand, so a row never needs the whole strip.
+ */
+class TiffLzwDecoder {
+public:
+	TiffLzwDecoder()
+	{
+		for (int i=0; i<256; i++)
+		{
+			prefix[i] = 0;
+			suffix[i] = (unsigned char)i;
+			length[i] = 1;
+		}
+		Reset(0);
+	}
+
+	void Reset(size_t strip_bytes)
+	{
+		left = strip_bytes;
+		in_pos = in_len = 0;
+		bit_buf = 0;
+		bit_count = 0;
+		code_len = 9;
+		next_code = TIFF_LZW_FIRST;
+		old_code = -1;
+		stack_pos = stack_len = 0;
+		done = false;
+	}
+
+	/** Decodes up to 'bytes' bytes of the current strip into 'dest', returns how many were produced */
+	size_t Decode(FILE * fp, unsigned char * dest, size_t bytes)
+	{
+		size_t out = 0;
+		while (out < bytes)
+		{
+			if (stack_pos < stack_len)
+			{
+				size_t n = min((size_t)(stack_len - stack_pos), bytes - out);
+				memcpy(dest + out, stack + stack_pos, n);
+				stack_pos += n;
+				out += n;
+				continue;
+			}
+			if (done)
+				break;
+
+			int code = NextCode(fp);
+			if (code == TIFF_LZW_EOI)
+			{
+				done = true;
+				break;
+			}
+			if (code == TIFF_LZW_CLEAR)
+			{
+				code_len = 9;
+				next_code = TIFF_LZW_FIRST;
+				old_code = -1;
+				continue;
+			}
+			if (old_code < 0)
+			{
+				if (code > 255)
+				{
+					done = true;
+					break;
+				}
+				Expand(code);
+				old_code = code;
+				continue;
+			}
+
+			if (code < next_code)
+				Expand(code);
+			else if (code == next_code)
+			{
+				// KwKwK : the code being defined is the previous string plus its own first byte
+				Expand(old_code);
+				stack[stack_len++] = stack[0];
+			}
+			else
+			{
+				done = true;
+				break;
+			}
+
+			if (next_code < (1 << TIFF_LZW_MAX_BITS))
+			{
+				prefix[next_code] = old_code;
+				suffix[next_code] = stack[0];
+				length[next_code] = length[old_code] + 1;
+				next_code++;
+				if (next_code >= (1 << code_len) - 1 && code_len < TIFF_LZW_MAX_BITS)
+					code_len++;
+			}
+			old_code = code;
+		}
+		return out;
+	}
+
+private:
+	int NextCode(FILE * fp)
+	{
+		while (bit_count < code_len)
+		{
+			if (in_pos == in_len)
+			{
+				size_t want = min(left, (size_t)TIFF_LZW_INPUT_BYTES);
+				in_len = want ? fread(in_buf, 1, want, fp) : 0;
+				in_pos = 0;
+				left -= in_len;
+				if (!in_len)
+					return TIFF_LZW_EOI;
+			}
+			bit_buf = (bit_buf << 8) | in_buf[in_pos++];
+			bit_count += 8;
+		}
+		bit_count -= code_len;
+		return (bit_buf >> bit_count) & ((1 << code_len) - 1);
+	}
+
+	void Expand(int code)
+	{
+		stack_len = length[code];
+		stack_pos = 0;
+		for (int i = stack_len - 1; i >= 0; i--)
+		{
+			stack[i] = suffix[code];
+			code = prefix[code];
+		}
+	}
+
+	unsigned short prefix[1 << TIFF_LZW_MAX_BITS];
+	unsigned char suffix[1 << TIFF_LZW_MAX_BITS];
+	unsigned short length[1 << TIFF_LZW_MAX_BITS];
+	unsigned char stack[(1 << TIFF_LZW_MAX_BITS) + 1];
+	int stack_pos, stack_len;
+
+	unsigned char in_buf[TIFF_LZW_INPUT_BYTES];
+	size_t in_pos, in_len, left;
+
+	unsigned int bit_buf;
+	int bit_count;
+	int code_len, next_code, old_code;
+	bool done;
+};
+
+static unsigned int get16(const unsigned char * p, bool big)
+{
+	return big ? (p[0] << 8) | p[1] : p[0] | (p[1] << 8);
+}
+
+static unsigned int get32(const unsigned char * p, bool big)
+{
+	return big ? ((unsigned int)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]
+		: p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+/* Reads the BYTE, SHORT or LONG values of a directory entry, stored inline or at an offset */
+static bool read_tag_values(FILE * fp, bool big, int type, unsigned int count, const unsigned char * field, vector<unsigned int> & values)
+{
+	int size = (type == 1) ? 1 : ((type == 3) ? 2 : ((type == 4) ? 4 : 0));
+	if (!size || !count || count > (1 << 24))
+		return false;
+
+	vector<unsigned char> data(count*size);
+	if (count*size <= 4)
+		memcpy(&data[0], field, count*size);
+	else if (fseek(fp, get32(field, big), SEEK_SET) || fread(&data[0], size, count, fp) != count)
+		return false;
+
+	values.resize(count);
+	for (unsigned int i=0; i<count; i++)
+		values[i] = (size == 1) ? data[i] : ((size == 2) ? get16(&data[2*i], big) : get32(&data[4*i], big));
+	return true;
+}
+
+TiffImage::TiffImage(const string & str_path) : Image(str_path, IMAGE_TIFF){
+	big_endian = false;
+	bits = 8;
+	compression = 1;
+	predictor = 1;
+	rows_per_strip = 0;
+	fp_r = NULL;
+	raw_r = NULL;
+	samples_r = NULL;
+	lzw_r = NULL;
+}
+
+TiffImage::~TiffImage(){
+	DestroyRowByRow();
+}
+
+/**
+ * Reads the first image file directory and checks that the image is one this reader handles.
+ */
+bool TiffImage::ReadDirectory(FILE * fp){
+	unsigned char header[8];
+	if (fread(header, 1, 8, fp) != 8)
+		return false;
+	big_endian = (header[0] == 'M');
+
+	unsigned char count_bytes[2];
+	if (fseek(fp, get32(&header[4], big_endian), SEEK_SET) || fread(count_bytes, 1, 2, fp) != 2)
+		return false;
+	unsigned int entries = get16(count_bytes, big_endian);
+
+	vector<unsigned char> directory(entries*12 + 1);
+	if (fread(&directory[0], 12, entries, fp) != entries)
+		return false;
+
+	int samples = 1, photometric = -1, planar = 1, sample_format = 1;
+	bool tiled = false;
+	imgWidth = imgHeight = 0;
+	bits = 1;
+	compression = 1;
+	predictor = 1;
+	rows_per_strip = 0;
+	strip_offsets.clear();
+	strip_byte_counts.clear();
+
+	for (unsigned int e=0; e<entries; e++)
+	{
+		const unsigned char * entry = &directory[e*12];
+		int tag = get16(entry, big_endian);
+		int type = get16(entry + 2, big_endian);
+		unsigned int count = get32(entry + 4, big_endian);
+
+		vector<unsigned int> values;
+		switch (tag)
+		{
+		case 256: case 257: case 258: case 259: case 262: case 273: case 277:
+		case 278: case 279: case 284: case 317: case 339:
+			if (!read_tag_values(fp, big_endian, type, count, entry + 8, values))
+			{
+				cout << "Invalid TIFF tag " << tag << " in " << imgPath << endl;
+				return false;
+			}
+			break;
+		case 322: case 323: case 324: case 325:
+			tiled = true;
+			continue;
+		default:
+			continue;
+		}
+
+		switch (tag)
+		{
+		case 256: imgWidth = values[0]; break;
+		case 257: imgHeight = values[0]; break;
+		case 258:
+			bits = values[0];
+			for (size_t i=1; i<values.size(); i++)
+				if ((int)values[i] != bits)
+					bits = -1;
+			break;
+		case 259: compression = values[0]; break;
+		case 262: photometric = values[0]; break;
+		case 273: strip_offsets = values; break;
+		case 277: samples = values[0]; break;
+		case 278: rows_per_strip = values[0]; break;
+		case 279: strip_byte_counts = values; break;
+		case 284: planar = values[0]; break;
+		case 317: predictor = values[0]; break;
+		case 339: sample_format = values[0]; break;
+		}
+	}
+
+	imgNChannels = samples;
+	if (rows_per_strip <= 0 || rows_per_strip > imgHeight)
+		rows_per_strip = imgHeight;
+
+	const char * problem = NULL;
+	if (imgWidth <= 0 || imgHeight <= 0)
+		problem = "missing image size";
+	else if (tiled)
+		problem = "tiled images are not supported";
+	else if (bits != 8 && bits != 16)
+		problem = "only 8 and 16 bits per sample are supported";
+	else if (sample_format != 1)
+		problem = "only unsigned integer samples are supported";
+	else if (samples != 1 && samples != 3)
+		problem = "only grey or RGB images are supported";
+	else if (photometric != -1 && photometric != 1 && photometric != 2)
+		problem = "unsupported photometric interpretation";
+	else if (samples > 1 && planar != 1)
+		problem = "planar images are not supported";
+	else if (compression != 1 && compression != 5)
+		problem = "only uncompressed and LZW images are supported";
+	else if (predictor != 1 && predictor != 2)
+		problem = "unsupported predictor";
+	else if (strip_offsets.size() != (size_t)((imgHeight + rows_per_strip - 1)/rows_per_strip) || strip_byte_counts.size() != strip_offsets.size())
+		problem = "invalid strip layout";
+
+	if (problem)
+	{
+		cout << "Cannot read TIFF " << imgPath << " : " << problem << endl;
+		return false;
+	}
+	return true;
+}
+
+bool TiffImage::LoadHeader(){
+	FILE * fp = fopen(imgPath.c_str(),"rb");
+	if(!fp) return false;
+
+	bool ok = ReadDirectory(fp);
+
+	fclose(fp);
+return ok;
+
+}
+
+bool TiffImage::StartStrip(int strip){
+	strip_r = strip;
+	row_in_strip_r = 0;
+
+	if (fseek(fp_r, strip_offsets[strip], SEEK_SET))
+		return false;
+	if (lzw_r)
+		lzw_r->Reset(strip_byte_counts[strip]);
+	return true;
+}
+
+bool TiffImage::PrepareRowByRow(){
+	fp_r = fopen(imgPath.c_str(),"rb");
+	if(!fp_r) return false;
+
+	if (!ReadDirectory(fp_r))
+	{
+		fclose(fp_r);
+		fp_r = NULL;
+		return false;
+	}
+
+	int samples = imgWidth*imgNChannels;
+	row_bytes_r = (size_t)samples*(bits/8);
+
+	raw_r = (unsigned char *)malloc(row_bytes_r);
+	if (bits == 16)
+		samples_r = (unsigned short *)malloc(sizeof(unsigned short) * samples);
+	if (compression == 5)
+		lzw_r = new TiffLzwDecoder();
+
+	rowData = (float *)realloc(rowData, sizeof(float) * samples);
+
+	return StartStrip(0);
+}
+
+bool TiffImage::LoadImageRowByRow(float * dest, size_t plane){
+
+	if (!dest)
+		dest = rowData;
+
+	if (row_in_strip_r == rows_per_strip && !StartStrip(strip_r + 1))
+		return false;
+	row_in_strip_r++;
+
+	size_t got = lzw_r ? lzw_r->Decode(fp_r, raw_r, row_bytes_r) : fread(raw_r, 1, row_bytes_r, fp_r);
+	if (got != row_bytes_r)
+		return false;
+
+	int samples = imgWidth*imgNChannels;
+
+	if (bits == 8)
+	{
+		if (predictor == 2)
+			for (int j = imgNChannels; j < samples; j++)
+				raw_r[j] += raw_r[j - imgNChannels];
+
+		ConvertRow8(raw_r, dest, samples, plane);
+		return true;
+	}
+
+	for (int j = 0; j < samples; j++)
+		samples_r[j] = get16(&raw_r[2*j], big_endian);
+
+	if (predictor == 2)
+		for (int j = imgNChannels; j < samples; j++)
+			samples_r[j] += samples_r[j - imgNChannels];
+
+	ConvertRow16(samples_r, dest, samples, 65535, plane);
+
+	return true;
+
+}
+
+bool TiffImage::DestroyRowByRow(){
+	if (fp_r)
+		fclose(fp_r);
+	fp_r = NULL;
+
+	free(raw_r);
+	raw_r = NULL;
+	free(samples_r);
+	samples_r = NULL;
+	delete lzw_r;
+	lzw_r = NULL;
+
+	return true;
+}
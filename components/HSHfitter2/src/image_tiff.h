@@ -0,0 +1,72 @@
+/*  HSHFitter
+ *  Copyright (C) 2009-11 UC Santa Cruz and Cultural Heritage Imaging
+ *    
+ *  Portions Copyright (C) 2010-11 Univ. do Minho and Cultural Heritage Imaging
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 3 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _IMAGE_TIFF_H
+#define	_IMAGE_TIFF_H
+
+#include <vector>
+
+#include "image.h"
+
+class TiffLzwDecoder;
+
+/*
+ * Baseline TIFF reader for the linear captures coming out of raw converters:
+ * strips (no tiles), chunky 8 or 16-bit grey or RGB samples, uncompressed or LZW,
+ * with or without horizontal differencing. Only the current row is kept in memory,
+ * even when the whole image is stored in a single strip.
+ */
+class TiffImage : public Image {
+public:
+    TiffImage(const string & str_path);
+    ~TiffImage();
+
+    bool LoadHeader();
+
+    bool LoadImageRowByRow(float * dest = NULL, size_t plane = 0);
+
+    bool PrepareRowByRow();
+    bool DestroyRowByRow();
+
+private:
+    bool ReadDirectory(FILE * fp);
+    bool StartStrip(int strip);
+
+    bool big_endian;
+    int bits;
+    int compression;
+    int predictor;
+    int rows_per_strip;
+    vector<unsigned int> strip_offsets;
+    vector<unsigned int> strip_byte_counts;
+
+    FILE * fp_r;
+
+    int strip_r;
+    int row_in_strip_r;
+    size_t row_bytes_r;
+
+    unsigned char * raw_r;
+
+    unsigned short * samples_r;
+
+    TiffLzwDecoder * lzw_r;
+
+};
+
+#endif	/* _IMAGE_TIFF_H */
@@ -39,9 +39,25 @@ Input::Input(string str_main_path, string str_prefix, string str_lights_filename
 		str_prefix(str_prefix), str_lights_filename(str_lights_filename), str_correction_filename(str_correction_filename)
 			,is_row_by_row(is_row_by_row), order(order), output(output)
 {
+	block_rows = 1;
+	robust_iterations = 0;
+	is_auto_plan = false;
+	mem_limit = 0;
+	progress_interval = 0;
+	ptm_format = PTM_NONE;
+	web_levels = 3;
+	rect_angle = 0;
+	image_opener = NULL;
+	image_opener_context = NULL;
 	this->str_main_path = str_main_path;
 }
 
+Image * Input::open_image(const string & filename){
+	if (image_opener)
+		return image_opener(filename, image_opener_context);
+	return Image::Create(filename);
+}
+
 /**
  * Function that counts the number of images in a directory given a prefix and path
  *
@@ -138,9 +154,14 @@ int Input::read_lp()
 /* Reads in color correction scaling values from 'str_correction_filename'  */
 /* The special lines with 1 1 1 in the file means that the light should not */
 /* be used. The variable 'num_used' is updated with the actual number of    */
-/* lights used.	*/
+/* lights used. Lights without a line in the file keep a scale of 1.		*/
 int Input::read_color_correction()
 {
+	for (int i=0; i<num_files; i++)
+		lit_images[i].scale_r = lit_images[i].scale_g = lit_images[i].scale_b = 1;
+
+	if (str_correction_filename.empty()) return num_files; // .lp input, no corrections file
+
 	ifstream fix_file((str_main_path + str_correction_filename).c_str());
 
 	if (!fix_file) return num_files; // no corrections file, use all lighting positions
@@ -148,7 +169,12 @@ int Input::read_color_correction()
 	int count_used = 0;
 	for (int i=0; i<num_files; i++)
 	{
-		fix_file >> lit_images[i].scale_r >> lit_images[i].scale_g >> lit_images[i].scale_b;
+		if (!(fix_file >> lit_images[i].scale_r >> lit_images[i].scale_g >> lit_images[i].scale_b))
+		{
+			lit_images[i].scale_r = lit_images[i].scale_g = lit_images[i].scale_b = 1;
+			count_used++;
+			continue;
+		}
 		if (lit_images[i].scale_r == 1 && lit_images[i].scale_g == 1 &&  lit_images[i].scale_b == 1)
 		{
 			lit_images[i].used = false;
@@ -182,15 +208,19 @@ bool Input::read_inputs2(){
     }
 
     //Read an arbitrary image to get some information properties
-    Image * img = new Image(lit_images[0].filename,0);
+    Image * img = open_image(lit_images[0].filename);
     if(!img) return false;
 
-    img->LoadHeader();
+    if(!img->LoadHeader()) {
+        delete img;
+        return false;
+    }
 
     height = img->imgHeight;
     width = img->imgWidth;
     channels = img->imgNChannels;
     fullheight = height;
+    delete img;
 
     cout << "Sample Image -> W: " << width << " H: " << height << " Channels: " << channels << endl;
 
@@ -210,17 +240,33 @@ bool Input::read_inputs()
 	if (!num_files)
 		return false;
 
-	lit_images.resize(num_files);
-
 	filenames.sort();
+	vector<string> image_files;
 	list<string>::iterator it;
-	int count = 0;
 	for ( it=filenames.begin() ; it != filenames.end(); it++ )
 	{
 		//cout << "Assign *it " << *it <<endl;
-		lit_images[count].filename.assign(str_main_path + (*it));
-		lit_images[count].used = true;
-		count++;
+		image_files.push_back(str_main_path + (*it));
+	}
+
+	return read_inputs(image_files);
+}
+
+/* Same as read_inputs, for images already listed by the caller (full paths, in the	*/
+/* order of the light positions file), as the Windows fitter lists them.				*/
+bool Input::read_inputs(const vector<string> & image_files)
+{
+	num_files = image_files.size();
+
+	if (!num_files)
+		return false;
+
+	lit_images.resize(num_files);
+
+	for (int i=0; i<num_files; i++)
+	{
+		lit_images[i].filename.assign(image_files[i]);
+		lit_images[i].used = true;
 	}
 
 	int num_light_positions = this->read_light_positions();
@@ -246,18 +292,23 @@ bool Input::read_inputs()
 	}
 
 	//Read an arbitrary image to get some information properties
-	Image * img = new Image(lit_images[0].filename,0);
+	Image * img = open_image(lit_images[0].filename);
 	if(!img) {
 		*output << " Error opening sample image " << lit_images[0].filename.c_str() << "! \r\n";
 		return false;
 	}
 
-	img->LoadHeader();
+	if (!img->LoadHeader()) {
+		*output << " Error reading sample image " << lit_images[0].filename.c_str() << "! \r\n";
+		delete img;
+		return false;
+	}
 
 	height = img->imgHeight;
 	width = img->imgWidth;
 	channels = img->imgNChannels;
 	fullheight = height;
+	delete img;
 
 	cout << "Sample Image -> W: " << width << " H: " << height << " Channels: " << channels << endl;
 
@@ -17,8 +17,18 @@
 
 using namespace std;
 
+// opens the reader of a lit image, see Input::set_image_opener
+typedef Image * (*ImageOpener)(const string & filename, void * context);
+
+// PTM output of the fit : none, one polynomial per color channel, or a luminance polynomial and a color per pixel
+#define PTM_NONE 0
+#define PTM_RGB 1
+#define PTM_LRGB 2
+
 class LitImage {
 public:
+	LitImage() : img(NULL) {}
+
 	bool used;						  // is this a valid image
 	double lx, ly, lz;				  // lighting angle
 	double scale_r, scale_g, scale_b; // color correction scales
@@ -37,8 +47,20 @@ public:
 
     void set_row_by_row(bool is_row_by_row) {this->is_row_by_row = is_row_by_row;};
     void set_compressed(bool is_compressed) {this->is_compressed = is_compressed;};
+    void set_block_rows(int block_rows) {this->block_rows = block_rows;};
+    void set_robust_iterations(int robust_iterations) {this->robust_iterations = robust_iterations;};
+    void set_auto_plan(bool is_auto_plan) {this->is_auto_plan = is_auto_plan;};
+    void set_mem_limit(double mem_limit) {this->mem_limit = mem_limit;};
+    void set_stats_filename(string str_stats_filename) {this->str_stats_filename = str_stats_filename;};
+    void set_progress_interval(double progress_interval) {this->progress_interval = progress_interval;};
+    void set_basis_cache_dir(string str_basis_cache_dir) {this->str_basis_cache_dir = str_basis_cache_dir;};
+    void set_ptm_output(string str_ptm_filename, int ptm_format) {this->str_ptm_filename = str_ptm_filename; this->ptm_format = ptm_format;};
+    void set_web_output(string str_web_dir, int web_levels) {this->str_web_dir = str_web_dir; this->web_levels = web_levels;};
+    void set_rectification(double rect_angle) {this->rect_angle = rect_angle;};
     void setMaxThreads(int maxThreads) {this->numberOfThreads = maxThreads;}
+    void set_image_opener(ImageOpener opener, void * context) {this->image_opener = opener; this->image_opener_context = context;};
     bool read_inputs();
+    bool read_inputs(const vector<string> & image_files);
     bool read_inputs2();
 
 
@@ -49,6 +71,9 @@ public:
     int read_lp();
     int read_color_correction() ;
 
+    // reader of a lit image : Image::Create unless the images come from somewhere else than files
+    Image * open_image(const string & filename);
+
     int numberOfThreads; //Used to set the OpenMP number of threads
 
     string str_main_path;		// the main working directory (where all the files are)
@@ -56,7 +81,11 @@ public:
     string str_lights_filename;	// light positions filename
     string str_correction_filename; // color corrections filename
 
-    string str_output_filename;  // output filename
+    string str_output_filename;  // output filename, no HSH is fitted when empty
+    string str_ptm_filename;     // PTM output filename, used unless ptm_format is PTM_NONE
+    string str_stats_filename;   // JSON statistics of the fit, none when empty
+    string str_basis_cache_dir;  // directory of the saved HSH basis matrices, none when empty
+    string str_web_dir;          // directory of the tiles for the remote viewer, none when empty
 
     vector<LitImage> lit_images; // the information about all light positions, filenames, scale values etc.
     list<string> filenames; // the list of files matching the prefix
@@ -65,12 +94,23 @@ public:
 
     bool is_row_by_row;		// is the 'reading and processing of images done on a row by row basis?'
     bool is_compressed;		// are we saving the data in compressed form?
+    bool is_auto_plan;		// choose between in memory and row-by-row, and the block size, from the memory limit
+    double mem_limit;		// memory limit of the planner in bytes, 0 for a share of the available memory
+    double progress_interval;	// seconds between progress lines, 0 for none
 
     int order;					 // the order of the hsh fitting
     int fullheight;				// image height
     int width;					// image width
     int height;					// 'block' height, number of rows for which the fitting is done per turn
+    int block_rows;				// requested block height for the row-by-row reader
+    int robust_iterations;		// maximum number of outlier rejection passes, 0 for a plain least squares fit
     int channels;				// number of color channels
+    int ptm_format;				// PTM_NONE, PTM_RGB or PTM_LRGB
+    int web_levels;				// resolution levels of the tiles
+    double rect_angle;			// rotation of the images about their centre before the fit, in degrees, 0 for none
+
+    ImageOpener image_opener;	// opens the lit images instead of Image::Create, none when NULL
+    void * image_opener_context;	// passed back to image_opener
 
 
 };
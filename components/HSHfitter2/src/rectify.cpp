@@ -0,0 +1,134 @@
+/*  HSHFitter
+ *  Copyright (C) 2009-11 UC Santa Cruz and Cultural Heritage Imaging
+ *    
+ *  Portions Copyright (C) 2010-11 Univ. do Minho and Cultural Heritage Imaging
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 3 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <math.h>
+#include <fstream>
+#include <algorithm>
+#include "rectify.h"
+
+using namespace std;
+
+ImageRectifier::ImageRectifier(int width, int height, double angle) :
+		angle(angle), width(width), height(height)
+{
+	// centre and rotation of cv2DRotationMatrix, inverted : the warp looks up the source of every output pixel
+	cx = width/2;
+	cy = height/2;
+	cos_a = cos(angle*3.14159265358979323846/180);
+	sin_a = sin(angle*3.14159265358979323846/180);
+}
+
+bool ImageRectifier::read_axis_file(const string & filename, double & angle)
+{
+	ifstream axis_file(filename.c_str());
+	double axis_x, axis_y, axis_z;
+
+	if (!(axis_file >> axis_x >> axis_y >> axis_z))
+		return false;
+
+	angle = 90.0 + (atan(axis_y/axis_x) * 180 / 3.14159265358979323846);
+	return angle == angle; // no angle for a null axis
+}
+
+/**
+ * Source rows read by the bilinear lookups of the output rows [y0, y1), with a row
+ * of margin on each side for rounding. 'first' is past 'last' when every lookup is outside the image.
+ */
+void ImageRectifier::source_span(int y0, int y1, int & first, int & last) const
+{
+	double across = min(sin_a*(0-cx), sin_a*(width-1-cx));
+	double across_max = max(sin_a*(0-cx), sin_a*(width-1-cx));
+	double down = min(cos_a*(y0-cy), cos_a*(y1-1-cy));
+	double down_max = max(cos_a*(y0-cy), cos_a*(y1-1-cy));
+
+	first = (int)floor(cy + across + down) - 1;
+	last = (int)floor(cy + across_max + down_max) + 2;
+	if (last < 0 || first > height-1)
+	{
+		first = height;
+		last = -1;
+		return;
+	}
+	first = max(first, 0);
+	last = min(last, height-1);
+}
+
+/**
+ * The readers only go forward, so the rows up to the furthest row any block so far needs
+ * are decoded, and a row is kept until no later block needs it.
+ */
+int ImageRectifier::plan(int block_rows)
+{
+	if (block_rows < 1) block_rows = 1;
+	int blocks = (height + block_rows - 1) / block_rows;
+	vector<int> first(blocks), last(blocks);
+
+	read_to.resize(blocks);
+	int decoded = -1;
+	for (int b=0; b<blocks; b++)
+	{
+		source_span(b*block_rows, min(height, (b+1)*block_rows), first[b], last[b]);
+		decoded = max(decoded, last[b]);
+		read_to[b] = decoded;
+	}
+
+	int kept = height;
+	int window_rows = 1;
+	for (int b=blocks-1; b>=0; b--)
+	{
+		kept = min(kept, first[b]);
+		if (read_to[b] >= kept)
+			window_rows = max(window_rows, read_to[b]-kept+1);
+	}
+	return min(window_rows, height);
+}
+
+void ImageRectifier::warp(const float * window, int window_rows, float * dest, int y0, int rows) const
+{
+	for (int j=0; j<rows; j++)
+	{
+		double dy = y0 + j - cy;
+		double sx = cx - cos_a*cx - sin_a*dy;
+		double sy = cy - sin_a*cx + cos_a*dy;
+		float * out = dest + (size_t)j*width;
+
+		for (int x=0; x<width; x++, sx += cos_a, sy += sin_a)
+		{
+			double left = floor(sx), top = floor(sy);
+			int x0 = (int)left, y0s = (int)top;
+			if (x0 < -1 || x0 >= width || y0s < -1 || y0s >= height)
+			{
+				out[x] = 0;
+				continue;
+			}
+
+			float fx = (float)(sx - left), fy = (float)(sy - top);
+			float v[2][2] = { { 0, 0 }, { 0, 0 } };
+			for (int r=0; r<2; r++)
+			{
+				int y = y0s + r;
+				if (y < 0 || y >= height) continue;
+				const float * row = window + (size_t)(y % window_rows)*width;
+				if (x0 >= 0) v[r][0] = row[x0];
+				if (x0+1 < width) v[r][1] = row[x0+1];
+			}
+			out[x] = (v[0][0]*(1-fx) + v[0][1]*fx)*(1-fy) + (v[1][0]*(1-fx) + v[1][1]*fx)*fy;
+		}
+	}
+}
@@ -0,0 +1,67 @@
+/*  HSHFitter
+ *  Copyright (C) 2009-11 UC Santa Cruz and Cultural Heritage Imaging
+ *    
+ *  Portions Copyright (C) 2010-11 Univ. do Minho and Cultural Heritage Imaging
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 3 as published
+ *  by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _RECTIFY_H
+#define	_RECTIFY_H
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Axis rectification of the lit images : a rotation about the image centre, as cvWarpAffine
+ * with cv2DRotationMatrix(centre, angle, 1) (bilinear, black outside the image, same size).
+ * It is applied to every block of rows as it is staged for the fit, so the images are never
+ * rewritten on disk. The row-by-row reader keeps a window of decoded source rows, with row r
+ * in slot r % window_rows, large enough for the source rows of the block being warped.
+ */
+class ImageRectifier {
+public:
+	ImageRectifier(int width, int height, double angle);
+
+	/**
+	 * Reads the rotation of the images from an axis file (the x, y and z of the axis),
+	 * as the axis rectification of the Windows fitter. Returns false if it cannot be read.
+	 */
+	static bool read_axis_file(const string & filename, double & angle);
+
+	/** Plans the source window for blocks of 'block_rows' output rows and returns its number of rows. */
+	int plan(int block_rows);
+
+	/** Last source row that must be decoded before output block 'block' of the plan is warped, -1 for none. */
+	int last_source_row(int block) const { return read_to[block]; }
+
+	/**
+	 * Warps the output rows [y0, y0+rows) of one channel to 'dest', from the source rows
+	 * of 'window', whose row r is at slot r % window_rows (the whole plane when window_rows is the height).
+	 */
+	void warp(const float * window, int window_rows, float * dest, int y0, int rows) const;
+
+	double angle;	// degrees, counter-clockwise
+
+private:
+	void source_span(int y0, int y1, int & first, int & last) const;
+
+	int width, height;
+	double cx, cy, cos_a, sin_a;
+	vector<int> read_to;	// per block, last source row decoded
+};
+
+#endif	/* _RECTIFY_H */
@@ -2019,7 +2019,7 @@ void j2k_setup_encoder(opj_j2k_t *j2k, opj_cparameters_t *parameters, opj_image_
 	int i, j, tileno, numpocs_tile;
 	opj_cp_t *cp = NULL;
 
-	if(!j2k || !parameters || ! image) {
+	if(!j2k || !parameters || ! image || image->numcomps <= 0) {
 		return;
 	}
 
@@ -2194,7 +2194,7 @@ void j2k_setup_encoder(opj_j2k_t *j2k, opj_cparameters_t *parameters, opj_image_
 			tcp->numpocs = 0;
 		}
 
-		tcp->tccps = (opj_tccp_t*) opj_calloc(image->numcomps, sizeof(opj_tccp_t));
+		tcp->tccps = (opj_tccp_t*) opj_calloc((unsigned int)image->numcomps, sizeof(opj_tccp_t));
 
 		for (i = 0; i < image->numcomps; i++) {
 			opj_tccp_t *tccp = &tcp->tccps[i];
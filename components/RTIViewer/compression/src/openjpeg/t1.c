@@ -739,11 +739,13 @@ static double t1_getwmsedec(
 		int numcomps)
 {
 	double w1, w2, wmsedec;
+	/* the MCT norms only exist for the first 3 components, reading past them gave garbage */
+	/* distortions to the rate allocation, which then dropped passes of lossless images */
 	if (qmfbid == 1) {
-		w1 = (numcomps > 1) ? mct_getnorm(compno) : 1.0;
+		w1 = (numcomps > 1 && compno < 3) ? mct_getnorm(compno) : 1.0;
 		w2 = dwt_getnorm(level, orient);
 	} else {			/* if (qmfbid == 0) */
-		w1 = (numcomps > 1) ? mct_getnorm_real(compno) : 1.0;
+		w1 = (numcomps > 1 && compno < 3) ? mct_getnorm_real(compno) : 1.0;
 		w2 = dwt_getnorm_real(level, orient);
 	}
 	wmsedec = w1 * w2 * stepsize * (1 << bpno);
@@ -46,6 +46,7 @@ private:
 	QSpinBox* widthSpinBox; /*!< Spinbox to set the width of the browser. */
 	QSpinBox* heightSpinBox; /*!< Spinbox ro set the height of the browser. */
 	QCheckBox* fullSizeCkb; /*!< Checkbox to select the full-size. */ 
+	QCheckBox* progressiveCkb; /*!< Checkbox to select the progressive open of local files. */
 
 public:
 	
@@ -54,9 +55,10 @@ public:
 	\param currentW current width of the browser.
 	\param currentH current height of the browser.
 	\param maxBrowserSize max size for the browser.
+	\param progressive current state of the progressive open.
 	\param parent
 	*/
-	ConfigDlg(int currentW, int currentH, const QSize& maxBrowserSize, QWidget* parent = 0)
+	ConfigDlg(int currentW, int currentH, const QSize& maxBrowserSize, bool progressive, QWidget* parent = 0)
 		: QDialog (parent)
 	{
 		QVBoxLayout* layout = new QVBoxLayout;
@@ -90,6 +92,13 @@ public:
 		groupLayout->addWidget(fullSizeCkb, 2, 1, 1, 1);
 		groupBox->setLayout(groupLayout);
 
+		QGroupBox* loadingBox = new QGroupBox("Loading", this);
+		QVBoxLayout* loadingLayout = new QVBoxLayout;
+		progressiveCkb = new QCheckBox("Progressive open", loadingBox);
+		progressiveCkb->setChecked(progressive);
+		loadingLayout->addWidget(progressiveCkb);
+		loadingBox->setLayout(loadingLayout);
+
 		QDialogButtonBox* buttonBox = new QDialogButtonBox(groupBox);
 		buttonBox->setStandardButtons(QDialogButtonBox::Cancel|QDialogButtonBox::Ok);
 
@@ -97,11 +106,12 @@ public:
 		connect(buttonBox, SIGNAL(rejected()), this, SLOT(reject()));
 
 		layout->addWidget(groupBox);
+		layout->addWidget(loadingBox);
 		layout->addWidget(buttonBox);
 		setLayout(layout);
 		
-		setMinimumSize(240, 160);
-		setMaximumSize(300, 200);
+		setMinimumSize(240, 210);
+		setMaximumSize(300, 250);
 
 		connect(fullSizeCkb, SIGNAL(stateChanged(int)), this, SLOT(setFullSize(int)));
 	};
@@ -114,6 +124,14 @@ public:
 		return QSize(widthSpinBox->value(), heightSpinBox->value());
 	};
 
+	/*!
+	  Returns true if the progressive open is selected.
+	*/
+	bool getProgressiveOpen()
+	{
+		return progressiveCkb->isChecked();
+	};
+
 private slots:
 
 	/*!
@@ -168,7 +168,7 @@ public:
 		const float* greenPtr = greenCoeff.getLevel(info.level);
 		const float* bluePtr = blueCoeff.getLevel(info.level);
 		int tempW = mipMapSize[info.level].width();
-        float hweights[9];
+        float hweights[HSH_MAX_TERMS];
 		vcg::Point3d temp(info.light.X(), info.light.Y(), info.light.Z());
 		temp.Normalize();
         float phi = atan2(temp.Y(), temp.X());
@@ -85,6 +85,12 @@ bool DiffuseGain::enabledLighting()
 }
 
 
+int DiffuseGain::normalsUsage()
+{
+	return VIEW_NORMALS;
+}
+
+
 float DiffuseGain::getGain()
 {
     // Get the gain as a value normalized to the range [0,100]
@@ -96,13 +96,19 @@ RtiViewerDlg::RtiViewerDlg(QWidget *parent/*=0*/):
     setWindowTitle(title);
     setAcceptDrops(true);
 
-    // Initialize the Http thread and the application settings
+    // Initialize the Http thread, the loading thread and the application settings
 
     initHttpThread();
+    initLoadingThread();
     initAppSettings();
 
 }
 
+RtiViewerDlg::~RtiViewerDlg()
+{
+    loader->wait();
+}
+
 /*====================================================================
  * Private methods to construct the GUI
  *===================================================================*/
@@ -528,6 +534,19 @@ void RtiViewerDlg::initHttpThread()
     getter->start();
 }
 
+void RtiViewerDlg::initLoadingThread()
+{
+    // Create the thread for the progressive loading of local files
+
+    loader = new LoadingThread(this);
+    progressiveImage = NULL;
+
+    // Connect the loading thread and the browser
+
+    connect(loader, SIGNAL(levelReady()), browser, SLOT(updateImage()));
+    connect(loader, SIGNAL(loaded(Rti*, int)), this, SLOT(progressiveLoadEnded(Rti*, int)));
+}
+
 void RtiViewerDlg::initAppSettings()
 {
     // Create new application settings
@@ -577,6 +596,12 @@ int RtiViewerDlg::openFile(QString path)
     }
     if (data.open(QFile::ReadOnly))
     {
+        // The image of a progressive load in progress is released only when the load ends.
+        QApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
+        loader->wait();
+        progressiveImage = NULL;
+        QApplication::restoreOverrideCursor();
+
         Rti* image = NULL;
         LoadingDlg* loading = new LoadingDlg(this);
         if (info.suffix() == "ptm")
@@ -613,9 +638,15 @@ int RtiViewerDlg::openFile(QString path)
         filesize->setText("");
         fileformat->setText("");
         int result = 0;
+        bool progressive = false;
         try
         {
-            result = image->load(LoadingDlg::QCallBack);
+            // With the progressive open a coarse level is shown as soon as it is read and
+            // the full resolution is loaded by the loading thread.
+            if (settings->value("progressiveOpen", true).toBool() && image->loadCoarse(LoadingDlg::QCallBack) == 0)
+                progressive = true;
+            else
+                result = image->load(LoadingDlg::QCallBack);
         }
         catch (std::bad_alloc&)
         {
@@ -646,6 +677,13 @@ int RtiViewerDlg::openFile(QString path)
             // Open the bookmark file, if any.
 
             bookmarkControl->loadBookmarks(info);
+
+            if (progressive)
+            {
+                fileformat->setText(tr("%1 (loading)").arg(image->typeFormat()));
+                progressiveImage = image;
+                loader->load(image);
+            }
         }
         else if (result == -1)
         {
@@ -677,6 +715,8 @@ int RtiViewerDlg::openRemote()
     {
         settings->setValue("lastUrl", lastUrl.toString());
         QApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
+        loader->wait();
+        progressiveImage = NULL;
         QString path = lastUrl.path();
         QUrl* url = new QUrl(lastUrl);
         Rti* imageRti;
@@ -792,6 +832,34 @@ void RtiViewerDlg::httpErrorOccurred(QString error)
     QMessageBox::critical(this, "HTTP Error", error);
 }
 
+void RtiViewerDlg::progressiveLoadEnded(Rti* rti, int result)
+{
+    // Ignore the loads of the images already closed.
+    if (rti != progressiveImage)
+        return;
+    progressiveImage = NULL;
+    if (result == 0)
+    {
+        navigator->setImage(rti->createPreview(344, 226), rti->width(), rti->height());
+        fileformat->setText(rti->typeFormat());
+        browser->updateImage();
+    }
+    else
+    {
+        QString path = filename->text();
+        browser->setImage(NULL);
+        navigator->setImage(NULL, 0, 0);
+        rendDlg->setRenderingMode(NULL, 0);
+        filename->setText("");
+        filesize->setText("");
+        fileformat->setText("");
+        if (result == -2)
+            QMessageBox::critical(this, tr("Opening error"), tr("The virtual memory is not\n suffice to open the file"));
+        else
+            QMessageBox::critical(this, tr("Opening error"), tr("The file: \n%1\n is invalid.\n Internal format unknown.").arg(path));
+    }
+}
+
 /*====================================================================
  * Configure the viewer
  *===================================================================*/
@@ -800,10 +868,16 @@ void RtiViewerDlg::configure()
 {
 	int currentW = settings->value("maxWindowWidth").toInt();
 	int currentH = settings->value("maxWindowHeight").toInt();
+	bool progressive = settings->value("progressiveOpen", true).toBool();
 	//Shows the configuration dialog.
-	ConfigDlg* dlg = new ConfigDlg(currentW, currentH, browser->getSize(), this);
+	ConfigDlg* dlg = new ConfigDlg(currentW, currentH, browser->getSize(), progressive, this);
 	if (dlg->exec() == 1) //User changed the application settings.
 	{
+		if (dlg->getProgressiveOpen() != progressive)
+		{
+			settings->setValue("progressiveOpen", dlg->getProgressiveOpen());
+			settings->sync();
+		}
 		QSize newSize = dlg->getCurrentSize();
 		if (newSize.height() != currentH  || newSize.width() != currentW)
 		{
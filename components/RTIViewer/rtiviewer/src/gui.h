@@ -37,6 +37,7 @@
 #include "universalrti.h"
 #include "multiviewrti.h"
 #include "httpthread.h"
+#include "loadingthread.h"
 
 // Qt headers
 #include <QWidget>
@@ -109,6 +110,9 @@ private:
 	HttpThread* getter; /*!< Secondary thread to get the RTI image from a remote server. */
 	QMutex* mutex; /*!< Mutex to provide a mutual exclusion lock between the GUI thread and the HTTP thread. */
 	QWaitCondition* infoReady; /*!< Wait condition to synchronize the GUI thread and the HTTP thread. */
+
+	LoadingThread* loader; /*!< Secondary thread to load the full resolution of a local image opened progressively. */
+	Rti* progressiveImage; /*!< Image in loading on the secondary thread, if any. */
 	
 	QSettings* settings; /*!< Application settings. */
 
@@ -134,6 +138,12 @@ public:
 	*/
 	RtiViewerDlg(QWidget *parent=0);
 
+	//! Deconstructor
+	/*!
+	  Waits for the loading thread, which uses the image owned by the browser.
+	*/
+	~RtiViewerDlg();
+
     //! Open an image file
     /*!
       Opens the image file specified by \a path.
@@ -220,6 +230,8 @@ private:
 
     void initHttpThread();
 
+    void initLoadingThread();
+
     void initAppSettings();
 
     /*!
@@ -243,6 +255,13 @@ private slots:
 	*/
 	void httpErrorOccurred(QString error);
 
+	/*!
+	  Manages the end of a progressive load.
+	  \param rti loaded image.
+	  \param result value returned by the load.
+	*/
+	void progressiveLoadEnded(Rti* rti, int result);
+
     /*====================================================================
      * Public slots
      *===================================================================*/
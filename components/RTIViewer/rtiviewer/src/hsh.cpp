@@ -33,6 +33,8 @@
 #include <QTime>
 #include <QDebug>
 
+#include <string.h>
+
 #if _MSC_VER
 #include <windows.h>
 #elif __MINGW32__
@@ -78,269 +80,370 @@ int Hsh::load(QString name, CallBackPos *cb)
 	if (cb != NULL)	(*cb)(0, "Loading HSH...");
 	filename = name;
 
+	int width, height, colors, order;
+	FILE* file = openHsh(width, height, colors, order);
+	if (file == NULL)
+		return -1;
+	
+	QString text = "Loading HSH...";
+	int ret = loadData(file, width, height, order * order, false, cb, text);
+	if (ret != 0)
+		return ret;
+
+	if (cb != NULL)	(*cb)(99, "Done");
+
+#ifdef PRINT_DEBUG
+	QTime second = QTime::currentTime();
+        float diff = first.msecsTo(second) / 1000.0;
+        printf("HSH Loading: %.5f s\n", diff);
+#endif
+
+	return 0;
+}
+
+
+FILE* Hsh::openHsh(int& width, int& height, int& colors, int& order)
+{
 #ifdef WIN32
   #ifndef __MINGW32__
 	FILE* file;
 	if (fopen_s(&file, filename.toStdString().c_str(), "rb") != 0)
-		return -1;
+		return NULL;
   #else
 	FILE* file = fopen(filename.toStdString().c_str(), "rb");
 	if (file == NULL)
-		return -1;
+		return NULL;
   #endif
 #else
 	FILE* file = fopen(filename.toStdString().c_str(), "rb");
 	if (file == NULL)
-		return -1;
+		return NULL;
 #endif
 
 	unsigned char c;
 
-	type = "HSH";
-
 	//parse comments		
 	c = fgetc(file);
 	if (feof(file))
-		return -1;
+	{
+		fclose(file);
+		return NULL;
+	}
 	while(c=='#')		
 	{
 		while (c != '\n')
 		{
 			c = fgetc(file);
 			if (feof(file))
-				return -1;
+			{
+				fclose(file);
+				return NULL;
+			}
 		}
 		c = fgetc(file);
 	}
 	if (feof(file))
-		return -1;
+	{
+		fclose(file);
+		return NULL;
+	}
 	//rewind one character
 	fseek(file, -1, SEEK_CUR);
 
+	// The header is only returned: the members can be in use by the renderings of a progressive load.
 	//read width
-	fread(&w, sizeof(int), 1, file);
+	fread(&width, sizeof(int), 1, file);
 	//read height
-	fread(&h, sizeof(int), 1, file);	
+	fread(&height, sizeof(int), 1, file);	
 	//read number of colors per pixel
-	fread(&bands, sizeof(int), 1, file);
+	fread(&colors, sizeof(int), 1, file);
 	//read number of coefficients per pixel
-	fread(&ordlen, sizeof(int), 1, file);
+	fread(&order, sizeof(int), 1, file);
 
-#if _MSC_VER || __MINGW32__
-	MEMORYSTATUSEX statex;
-	statex.dwLength = sizeof (statex);
-	GlobalMemoryStatusEx (&statex);
-	if (w*h*(ordlen*ordlen + 1)*16 > statex.ullAvailVirtual*0.95)
-		return -2;
-#endif
+	if (feof(file) || order < 1 || order > HSH_MAX_ORDER)
+	{
+		fclose(file);
+		return NULL;
+	}
+	return file;
+}
 
-	if (feof(file))
+
+int Hsh::loadCoarse(CallBackPos *cb)
+{
+	remote = false;
+	if (cb != NULL)	(*cb)(0, "Loading HSH preview...");
+	int width, height, colors, order;
+	FILE* file = openHsh(width, height, colors, order);
+	if (file == NULL)
 		return -1;
-	
-	ordlen *= ordlen;
-	
-	QString text = "Loading HSH...";
-	if (loadData(file, w, h, ordlen, false, cb, text) != 0)
+
+	// Nothing renders the image before its coarse level is loaded, the header is set directly.
+	type = "HSH";
+	w = width;
+	h = height;
+	bands = colors;
+	ordlen = order * order;
+	fread(gmin, sizeof(float), ordlen, file);
+	fread(gmax, sizeof(float), ordlen, file);
+	if (feof(file))
+	{
+		fclose(file);
 		return -1;
+	}
+	float scale[HSH_MAX_TERMS], bias[HSH_MAX_TERMS];
+	for (int k = 0; k < ordlen; k++)
+	{
+		scale[k] = (gmax[k] - gmin[k]) / 255.0f;
+		bias[k] = gmin[k];
+	}
 
-	if (cb != NULL)	(*cb)(99, "Done");
+	mipMapSize[0] = QSize(w, h);
+	mipMapSizes(mipMapSize, MIP_MAPPING_LEVELS - 1);
+
+	// The coarsest level is decimated, one pixel out of each block of 2^level x 2^level, and
+	// only the rows it samples are read from the file.
+	const int level = MIP_MAPPING_LEVELS - 1;
+	const int step = 1 << level;
+	const int coarseW = mipMapSize[level].width();
+	const int coarseH = mipMapSize[level].height();
+	const long rowBytes = (long)w * 3 * ordlen;
+	int size = coarseW * coarseH * ordlen;
+	float* coarse[3] = {new float[size], new float[size], new float[size]};
+	unsigned char* row = new unsigned char[rowBytes];
+	for (int y = 0; y < coarseH; y++)
+	{
+		if (cb != NULL && y % 16 == 0) (*cb)(y * 90.0 / coarseH, "Loading HSH preview...");
+		if (fread(row, rowBytes, 1, file) != 1)
+		{
+			delete[] row;
+			for (int c = 0; c < 3; c++)
+				delete[] coarse[c];
+			fclose(file);
+			return -1;
+		}
+		for (int x = 0; x < coarseW; x++)
+		{
+			const unsigned char* src = row + x * step * 3 * ordlen;
+			for (int c = 0; c < 3; c++, src += ordlen)
+			{
+				float* dst = coarse[c] + (y * coarseW + x) * ordlen;
+				for (int k = 0; k < ordlen; k++)
+					dst[k] = src[k] * scale[k] + bias[k];
+			}
+		}
+		if (y < coarseH - 1)
+			fseek(file, (step - 1) * rowBytes, SEEK_CUR);
+	}
+	delete[] row;
+	fclose(file);
 
-#ifdef PRINT_DEBUG
-	QTime second = QTime::currentTime();
-        float diff = first.msecsTo(second) / 1000.0;
-        printf("HSH Loading: %.5f s\n", diff);
-#endif
+	redCoefficients.setLevel(coarse[0], size, level);
+	greenCoefficients.setLevel(coarse[1], size, level);
+	blueCoefficients.setLevel(coarse[2], size, level);
 
+	// The normals are computed on demand, so the coarse level is ready to render.
+	levelsLock.lock();
+	normals.setLazy(mipMapSize);
+	readyLevel = level;
+	levelsLock.unlock();
 	return 0;
 }
 
 
 int Hsh::loadData(FILE* file, int width, int height, int basisTerm, bool urti, CallBackPos * cb,const QString& text)
 {
-	type = "HSH";
-	w = width;
-	h = height;
-
-	ordlen = basisTerm;
-	bands = 3;
-	fread(gmin, sizeof(float), basisTerm, file);
-	fread(gmax, sizeof(float), basisTerm, file);
+	if (basisTerm < 1 || basisTerm > HSH_MAX_TERMS)
+		return -1;
+	float fileMin[HSH_MAX_TERMS], fileMax[HSH_MAX_TERMS];
+	fread(fileMin, sizeof(float), basisTerm, file);
+	fread(fileMax, sizeof(float), basisTerm, file);
 
 	if (feof(file))
 		return -1;
 
-	int offset = 0;
-
-	int size = w * h * basisTerm;
-	float* redPtr = new float[size];
-	float* greenPtr = new float[size];
-	float* bluePtr = new float[size];
-	
-	unsigned char c;
+	// After loadCoarse this runs on the loading thread while the coarse level is rendered with
+	// the header already set: the file must still have that header, which is left untouched.
+	// Otherwise the header is set, under the lock like the levels.
+	levelsLock.lock();
+	const bool progressive = readyLevel > 0;
+	const bool sameHeader = w == width && h == height && ordlen == basisTerm &&
+		memcmp(gmin, fileMin, basisTerm * sizeof(float)) == 0 && memcmp(gmax, fileMax, basisTerm * sizeof(float)) == 0;
+	if (!progressive)
+	{
+		type = "HSH";
+		w = width;
+		h = height;
+		ordlen = basisTerm;
+		bands = 3;
+		memcpy(gmin, fileMin, basisTerm * sizeof(float));
+		memcpy(gmax, fileMax, basisTerm * sizeof(float));
+		mipMapSize[0] = QSize(w, h);
+	}
+	levelsLock.unlock();
+	if (progressive && !sameHeader)
+	{
+		fclose(file);
+		return -1;
+	}
 
-	if (!urti)
+	// The finest level is kept quantized, one byte per coefficient, for large images and for
+	// the images whose float expansion does not fit in memory.
+	double pixels = (double)w * h;
+	bool quantized = pixels >= HSH_QUANTIZED_MIN_PIXELS;
+#if _MSC_VER || __MINGW32__
+	MEMORYSTATUSEX statex;
+	statex.dwLength = sizeof (statex);
+	GlobalMemoryStatusEx (&statex);
+	// The float levels and the normals take (basisTerm + 1)*16 bytes per pixel. With the
+	// quantized level 0 they take 3*basisTerm bytes plus about 4*basisTerm + 16 for the levels above.
+	if (!quantized && pixels*(basisTerm + 1)*16 > statex.ullAvailVirtual*0.95)
+		quantized = true;
+	if (quantized && pixels*(7*basisTerm + 16) > statex.ullAvailVirtual*0.95)
 	{
-		for(int j = 0; j < h; j++)
-		{
-			if (cb != NULL && j % 50 == 0)(*cb)(j * 50.0 / h, text);
-			for(int i = 0; i < w; i++)
-			{				
-				offset = j * w + i;
-				for (int k = 0; k < basisTerm; k++)
-				{
-					if (feof(file))
-						return -1;
-					fread(&c, sizeof(unsigned char), 1, file);
-					redPtr[offset*basisTerm + k] = (((float)c) / 255.0) * (gmax[k] - gmin[k]) + gmin[k];
-				}
-				for (int k = 0; k < basisTerm; k++)
-				{
-					if (feof(file))
-						return -1;
-					fread(&c, sizeof(unsigned char), 1, file);
-					greenPtr[offset*basisTerm + k] = (((float)c) / 255.0) * (gmax[k] - gmin[k]) + gmin[k];
-				}
-				for (int k = 0; k < basisTerm; k++)
-				{
-					if (feof(file))
-						return -1;
-					fread(&c, sizeof(unsigned char), 1, file);
-					bluePtr[offset*basisTerm + k] = (((float)c) / 255.0) * (gmax[k] - gmin[k]) + gmin[k];
-				}
-			}
-		}
+		fclose(file);
+		return -2;
 	}
-	else
+#endif
+
+	// Dequantization table, value = c * scale[k] + bias[k]. The .hsh files store the min and max of
+	// each term, the Universal RTI files (urti) store its scale and bias.
+	float scale[HSH_MAX_TERMS], bias[HSH_MAX_TERMS];
+	for (int k = 0; k < basisTerm; k++)
 	{
-		for(int j = 0; j < h; j++)
-		{
-			if (cb != NULL && j % 50 == 0)(*cb)(j * 50 / h, text);
-			for(int i = 0; i < w; i++)
-			{				
-				offset = j * w + i;
-				for (int k = 0; k < basisTerm; k++)
-				{
-					if (feof(file))
-						return -1;
-					fread(&c, sizeof(unsigned char), 1, file);
-					redPtr[offset*basisTerm + k] = (((float)c) / 255.0) * gmin[k] + gmax[k];
-				}
-				for (int k = 0; k < basisTerm; k++)
-				{
-					if (feof(file))
-						return -1;
-					fread(&c, sizeof(unsigned char), 1, file);
-					greenPtr[offset*basisTerm + k] = (((float)c) / 255.0) * gmin[k] + gmax[k];
-				}
-				for (int k = 0; k < basisTerm; k++)
-				{
-					if (feof(file))
-						return -1;
-					fread(&c, sizeof(unsigned char), 1, file);
-					bluePtr[offset*basisTerm + k] = (((float)c) / 255.0) * gmin[k] + gmax[k];
-				}
-			}
-		}
+		scale[k] = urti ? fileMin[k] / 255.0f : (fileMax[k] - fileMin[k]) / 255.0f;
+		bias[k] = urti ? fileMax[k] : fileMin[k];
 	}
-	
-	fclose(file);
 
-	mipMapSize[0] = QSize(w, h);
+	const int rowBytes = w * 3 * basisTerm;
+	int bandRows = HSH_LOAD_BAND_BYTES / rowBytes;
+	if (bandRows < 1)
+		bandRows = 1;
+	if (bandRows > h)
+		bandRows = h;
 
-	redCoefficients.setLevel(redPtr, size, 0);
-	greenCoefficients.setLevel(greenPtr, size, 0);
-	blueCoefficients.setLevel(bluePtr, size, 0);
-	
-	// Computes mip-mapping.
-	if (cb != NULL)	(*cb)(50, "Mip mapping generation...");
-	
-	for (int level = 1; level < MIP_MAPPING_LEVELS; level++)
+	if (quantized)
 	{
-		int width = mipMapSize[level - 1].width();
-		int height = mipMapSize[level - 1].height();
-		int width2 = ceil(width / 2.0);
-		int height2 = ceil(height / 2.0);
-		size = width2*height2*basisTerm;
-		redCoefficients.setLevel(new float[size], size, level);
-		greenCoefficients.setLevel(new float[size], size, level);
-		blueCoefficients.setLevel(new float[size], size, level);
-		int th_id;
-		#pragma omp parallel for
-		for (int i = 0; i < height - 1; i+=2)
+		// The payload is mapped as it is when the file allows it, otherwise it is read in memory.
+		if (!quantizedLevel.map(filename, ftell(file), w, h, 3, basisTerm))
 		{
-			th_id = omp_get_thread_num();
-			if (th_id == 0)
+			unsigned char* bytes = quantizedLevel.allocate(w, h, 3, basisTerm);
+			for (int first = 0; first < h; first += bandRows)
 			{
-				if (cb != NULL && i % 50 == 0)	(*cb)(50 + (level-1)*8 + i*8.0/height, "Mip mapping generation...");
-			}
-			for (int j = 0; j < width - 1; j+=2)
-			{
-				int index1 = (i * width + j)*ordlen;
-				int index2 = (i * width + j + 1)*ordlen;
-				int index3 = ((i + 1) * width + j)*ordlen;
-				int index4 = ((i + 1) * width + j + 1)*ordlen;
-				int offset = (i/2 * width2 + j/2)*ordlen;
-				for (int k = 0; k < basisTerm; k++)
+				if (cb != NULL)(*cb)(first * 50.0 / h, text);
+				int rows = first + bandRows > h ? h - first : bandRows;
+				if ((int)fread(bytes + (size_t)first * rowBytes, rowBytes, rows, file) != rows)
 				{
-					redCoefficients.calcMipMapping(level, offset + k, index1 + k, index2 + k, index3 + k , index4 + k);
-					greenCoefficients.calcMipMapping(level, offset + k, index1 + k, index2 + k, index3 + k , index4 + k);
-					blueCoefficients.calcMipMapping(level, offset + k, index1 + k, index2 + k, index3 + k , index4 + k);
+					quantizedLevel.clear();
+					fclose(file);
+					return -1;
 				}
 			}
 		}
-		if (width2 % 2 != 0)
+		quantizedLevel.setDequantization(scale, bias);
+		fclose(file);
+		mipMapQuantized();
+	}
+	else
+	{
+		int size = w * h * basisTerm;
+		float* redPtr = new float[size];
+		float* greenPtr = new float[size];
+		float* bluePtr = new float[size];
+
+		// The payload is read in bands of rows, one fread per band, and each band is
+		// de-interleaved (R, G and B terms of a pixel) and dequantized in parallel over its rows.
+		unsigned char* band = new unsigned char[bandRows * rowBytes];
+
+		for (int first = 0; first < h; first += bandRows)
 		{
-			for (int i = 0; i < height - 1; i+=2)
+			if (cb != NULL)(*cb)(first * 50.0 / h, text);
+			int rows = first + bandRows > h ? h - first : bandRows;
+			if ((int)fread(band, rowBytes, rows, file) != rows)
 			{
-				int index1 = ((i + 1) * width - 1)*ordlen;
-				int index2 = ((i + 2) * width - 1)*ordlen;
-				int offset = ((i/2 + 1) * width2 - 1)*ordlen;
-				for (int k = 0; k < basisTerm; k++)
-				{
-					redCoefficients.calcMipMapping(level, offset + k, index1 + k, index2 + k);
-					greenCoefficients.calcMipMapping(level, offset + k, index1 + k, index2 + k);
-					blueCoefficients.calcMipMapping(level, offset + k, index1 + k, index2 + k);
-				}
+				delete[] band;
+				delete[] redPtr;
+				delete[] greenPtr;
+				delete[] bluePtr;
+				fclose(file);
+				return -1;
 			}
-		}
-		if (height % 2 != 0)
-		{
-			for (int i = 0; i < width - 1; i+=2)
+
+			#pragma omp parallel for
+			for (int j = 0; j < rows; j++)
 			{
-				int index1 = ((height - 1) * width + i)*ordlen;
-				int index2 = ((height - 1) * width + i + 1)*ordlen;
-				int offset = ((height2 - 1) * width2 + i/2)*ordlen;
-				for (int k = 0; k < basisTerm; k++)
+				const unsigned char* src = band + j * rowBytes;
+				int offset = (first + j) * w * basisTerm;
+				for (int i = 0; i < w; i++, offset += basisTerm)
 				{
-					redCoefficients.calcMipMapping(level, offset + k, index1 + k, index2 + k);
-					greenCoefficients.calcMipMapping(level, offset + k, index1 + k, index2 + k);
-					blueCoefficients.calcMipMapping(level, offset + k, index1 + k, index2 + k);
+					for (int k = 0; k < basisTerm; k++)
+						redPtr[offset + k] = src[k] * scale[k] + bias[k];
+					src += basisTerm;
+					for (int k = 0; k < basisTerm; k++)
+						greenPtr[offset + k] = src[k] * scale[k] + bias[k];
+					src += basisTerm;
+					for (int k = 0; k < basisTerm; k++)
+						bluePtr[offset + k] = src[k] * scale[k] + bias[k];
+					src += basisTerm;
 				}
 			}
 		}
-		if (height % 2 != 0 && width % 2 != 0)
-		{
-			int index1 = (height*width - 1)*ordlen;
-			int offset = (height2*width2 - 1)*ordlen;
-			for (int k = 0; k < basisTerm; k++)
-			{
-				redCoefficients.calcMipMapping(level, offset + k, index1 + k);
-				greenCoefficients.calcMipMapping(level, offset + k, index1 + k);
-				blueCoefficients.calcMipMapping(level, offset + k, index1 + k);
-			}
-		}
-		mipMapSize[level] = QSize(width2, height2);
+		delete[] band;
+		
+		fclose(file);
+
+		redCoefficients.setLevel(redPtr, size, 0);
+		greenCoefficients.setLevel(greenPtr, size, 0);
+		blueCoefficients.setLevel(bluePtr, size, 0);
+	}
+	
+	// Computes mip-mapping. The level 1 of a quantized image is already computed.
+	// The levels are computed apart and replaced under the lock, since a progressive load renders them.
+	if (cb != NULL)	(*cb)(50, "Mip mapping generation...");
+	const int first = quantizedLevel.isEmpty() ? 1 : 2;
+	QSize sizes[MIP_MAPPING_LEVELS];
+	sizes[first - 1] = mipMapSize[first - 1];
+	mipMapSizes(sizes + first - 1, MIP_MAPPING_LEVELS - first);
+	PyramidCoeffF* pyramids[3] = {&redCoefficients, &greenCoefficients, &blueCoefficients};
+	float* levels[3][MIP_MAPPING_LEVELS];
+	for (int c = 0; c < 3; c++)
+	{
+		for (int level = first; level < MIP_MAPPING_LEVELS; level++)
+			levels[c][level] = new float[sizes[level].width()*sizes[level].height()*ordlen];
+		mipMapLevels(pyramids[c]->getLevel(first - 1), levels[c] + first, MIP_MAPPING_LEVELS - first, sizes + first - 1, ordlen, basisTerm, cb, 50 + c*8, 8);
 	}
+	levelsLock.lock();
+	for (int level = first; level < MIP_MAPPING_LEVELS; level++)
+	{
+		int size = sizes[level].width()*sizes[level].height()*ordlen;
+		for (int c = 0; c < 3; c++)
+			pyramids[c]->setLevel(levels[c][level], size, level);
+		mipMapSize[level] = sizes[level];
+	}
+	// The normals are computed on demand by the rendering modes that read them.
+	normals.setLazy(mipMapSize);
+	normals.setPacked(0, !quantizedLevel.isEmpty());
+	readyLevel = 0;
+	levelsLock.unlock();
+
+	return 0;
+
+}
+
+
+void Hsh::calcNormals(int level, const QRect& rect)
+{
+	const QVector<QRect> tiles = normals.missingTiles(level, rect);
+	if (tiles.isEmpty())
+		return;
 
-	//Compute normals.
-	if (cb != NULL) (*cb)(75 , "Normals generation...");
 	Eigen::Vector3d l0(sin(M_PI/4)*cos(M_PI/6), sin(M_PI/4)*sin(M_PI/6), cos(M_PI/4));
 	Eigen::Vector3d l1(sin(M_PI/4)*cos(5*M_PI / 6), sin(M_PI/4)*sin(5*M_PI / 6), cos(M_PI/4));
 	Eigen::Vector3d l2(sin(M_PI/4)*cos(3*M_PI / 2), sin(M_PI/4)*sin(3*M_PI / 2), cos(M_PI/4));
-    float hweights0[16], hweights1[16], hweights2[16];
-	getHSH(M_PI / 4, M_PI / 6, hweights0, ordlen);
-	getHSH(M_PI / 4, 5*M_PI / 6, hweights1, ordlen);
-	getHSH(M_PI / 4, 3*M_PI / 2, hweights2, ordlen);
+    float hweights0[HSH_MAX_TERMS], hweights1[HSH_MAX_TERMS], hweights2[HSH_MAX_TERMS];
+	getHSH(M_PI / 4, M_PI / 6, hweights0, sqrt((float)ordlen));
+	getHSH(M_PI / 4, 5*M_PI / 6, hweights1, sqrt((float)ordlen));
+	getHSH(M_PI / 4, 3*M_PI / 2, hweights2, sqrt((float)ordlen));
 	
 	
 	Eigen::Matrix3d L;
@@ -349,52 +452,185 @@ int Hsh::loadData(FILE* file, int width, int height, int basisTerm, bool urti, C
 	L.row(1) = l1;
 	L.row(2) = l2;
 	Eigen::Matrix3d LInverse = L.inverse();
-	
-	for (int level = 0; level < MIP_MAPPING_LEVELS; level++)
+
+	const float* rPtr = redCoefficients.getLevel(level);
+	const float* gPtr = greenCoefficients.getLevel(level);
+	const float* bPtr = blueCoefficients.getLevel(level);
+	const int levelW = mipMapSize[level].width();
+	// The rows of a quantized level are dequantized one at a time, and the normals of a packed level
+	// are packed one tile at a time.
+	const bool fromQuantized = level == 0 && !quantizedLevel.isEmpty();
+	const bool packed = normals.isPacked(level);
+	vcg::Point3f* levelNormals = normals.levelData(level);
+
+	#pragma omp parallel
 	{
-		const float* rPtr = redCoefficients.getLevel(level);
-		const float* gPtr = greenCoefficients.getLevel(level);
-		const float* bPtr = blueCoefficients.getLevel(level);
-		vcg::Point3f* temp = new vcg::Point3f[mipMapSize[level].width()*mipMapSize[level].height()];
-		if (cb != NULL) (*cb)(75 + level*6, "Normal generation...");
-
-		#pragma omp parallel for
-		for (int y = 0; y < mipMapSize[level].height(); y++)
+		float* row = fromQuantized ? new float[NORMALS_TILE*ordlen*3] : NULL;
+		vcg::Point3f* tileNormals = packed ? new vcg::Point3f[NORMALS_TILE*NORMALS_TILE] : NULL;
+		#pragma omp for schedule(dynamic)
+		for (int t = 0; t < tiles.size(); t++)
 		{
-			for (int x = 0; x < mipMapSize[level].width(); x++)
+			const QRect& tile = tiles.at(t);
+			const int tw = tile.width();
+			for (int y = tile.top(); y <= tile.bottom(); y++)
 			{
-				int offset= y * mipMapSize[level].width() + x;
-				Eigen::Vector3d f(0, 0, 0);
-				for (int k = 0; k < ordlen; k++)
+				const float* rRow;
+				const float* gRow;
+				const float* bRow;
+				if (fromQuantized)
 				{
-					f(0) += rPtr[offset*ordlen + k] * hweights0[k];
-					f(1) += rPtr[offset*ordlen + k] * hweights1[k];
-					f(2) += rPtr[offset*ordlen + k] * hweights2[k];
+					quantizedLevel.dequantize(0, tile.left(), y, tw, 1, row);
+					quantizedLevel.dequantize(1, tile.left(), y, tw, 1, row + tw*ordlen);
+					quantizedLevel.dequantize(2, tile.left(), y, tw, 1, row + tw*ordlen*2);
+					rRow = row;
+					gRow = row + tw*ordlen;
+					bRow = row + tw*ordlen*2;
 				}
-				for (int k = 0; k < ordlen; k++)
+				else
 				{
-					f(0) += gPtr[offset*ordlen + k] * hweights0[k];
-					f(1) += gPtr[offset*ordlen + k] * hweights1[k];
-					f(2) += gPtr[offset*ordlen + k] * hweights2[k];
+					rRow = rPtr + (y*levelW + tile.left())*ordlen;
+					gRow = gPtr + (y*levelW + tile.left())*ordlen;
+					bRow = bPtr + (y*levelW + tile.left())*ordlen;
 				}
-				for (int k = 0; k < ordlen; k++)
+				vcg::Point3f* dst = packed ? tileNormals + (y - tile.top())*tw : levelNormals + y*levelW + tile.left();
+				for (int x = 0; x < tw; x++)
 				{
-					f(0) += bPtr[offset*ordlen + k] * hweights0[k];
-					f(1) += bPtr[offset*ordlen + k] * hweights1[k];
-					f(2) += bPtr[offset*ordlen + k] * hweights2[k];
+					Eigen::Vector3d f(0, 0, 0);
+					for (int k = 0; k < ordlen; k++)
+					{
+						f(0) += rRow[x*ordlen + k] * hweights0[k];
+						f(1) += rRow[x*ordlen + k] * hweights1[k];
+						f(2) += rRow[x*ordlen + k] * hweights2[k];
+					}
+					for (int k = 0; k < ordlen; k++)
+					{
+						f(0) += gRow[x*ordlen + k] * hweights0[k];
+						f(1) += gRow[x*ordlen + k] * hweights1[k];
+						f(2) += gRow[x*ordlen + k] * hweights2[k];
+					}
+					for (int k = 0; k < ordlen; k++)
+					{
+						f(0) += bRow[x*ordlen + k] * hweights0[k];
+						f(1) += bRow[x*ordlen + k] * hweights1[k];
+						f(2) += bRow[x*ordlen + k] * hweights2[k];
+					}
+					f /= 3.0;
+					Eigen::Vector3d normal = LInverse * f;
+					dst[x] = vcg::Point3f(normal(0), normal(1), normal(2));
+					dst[x].Normalize();
 				}
-				f /= 3.0;
-				Eigen::Vector3d normal = LInverse * f;
-				temp[offset] = vcg::Point3f(normal(0), normal(1), normal(2));
-				temp[offset].Normalize();
 			}
+			if (packed)
+				normals.pack(level, tile, tileNormals);
 		}
-		normals.setLevel(temp, mipMapSize[level].width()*mipMapSize[level].height(), level);
+		if (row)
+			delete[] row;
+		if (tileNormals)
+			delete[] tileNormals;
 	}
-	
+}
 
-	return 0;
 
+void Hsh::mipMapQuantized()
+{
+	int width = mipMapSize[0].width();
+	int height = mipMapSize[0].height();
+	int width2 = ceil(width / 2.0);
+	int height2 = ceil(height / 2.0);
+	int size = width2*height2*ordlen;
+	float* level1[3] = {new float[size], new float[size], new float[size]};
+	redCoefficients.setLevel(level1[0], size, 1);
+	greenCoefficients.setLevel(level1[1], size, 1);
+	blueCoefficients.setLevel(level1[2], size, 1);
+
+	// Each pixel is the average of the 2x2 block below it, of the 2x1 or 1x2 block on the
+	// odd edges and of the single pixel in the odd corner.
+	const int rowLen = width*ordlen;
+	#pragma omp parallel
+	{
+		float* rows = new float[rowLen*2];
+		#pragma omp for
+		for (int i = 0; i < height2; i++)
+		{
+			bool twoRows = 2*i + 1 < height;
+			for (int c = 0; c < 3; c++)
+			{
+				quantizedLevel.dequantize(c, 0, 2*i, width, twoRows ? 2 : 1, rows);
+				float* dst = level1[c] + i*width2*ordlen;
+				for (int j = 0; j < width2; j++, dst += ordlen)
+				{
+					const float* p = rows + 2*j*ordlen;
+					bool twoCols = 2*j + 1 < width;
+					for (int k = 0; k < ordlen; k++)
+					{
+						if (twoRows && twoCols)
+							dst[k] = (p[k] + p[ordlen + k] + p[rowLen + k] + p[rowLen + ordlen + k])*0.25f;
+						else if (twoCols)
+							dst[k] = (p[k] + p[ordlen + k])*0.5f;
+						else if (twoRows)
+							dst[k] = (p[k] + p[rowLen + k])*0.5f;
+						else
+							dst[k] = p[k];
+					}
+				}
+			}
+		}
+		delete[] rows;
+	}
+	mipMapSize[1] = QSize(width2, height2);
+}
+
+
+void Hsh::renderQuantized(const RenderingInfo& info, unsigned char* buffer)
+{
+	RenderingMode* mode = list->value(currentRendering);
+	const bool readNormals = mode->normalsUsage() != NO_NORMALS;
+	const int tileSize = HSH_RENDER_TILE_SIZE;
+	const int tilesX = (info.width + tileSize - 1) / tileSize;
+	const int tilesY = (info.height + tileSize - 1) / tileSize;
+
+	// The tiles are rendered in parallel, each one by a single thread from its own dequantized
+	// copy of the coefficients and the normals.
+	#pragma omp parallel
+	{
+		int size = tileSize*tileSize*ordlen;
+		float* redPtr = new float[size];
+		float* greenPtr = new float[size];
+		float* bluePtr = new float[size];
+		vcg::Point3f* tileNormals = new vcg::Point3f[tileSize*tileSize];
+		PyramidCoeffF red, green, blue;
+		PyramidNormals tileNormalsPyramid;
+		red.setLevel(redPtr, size, 0);
+		green.setLevel(greenPtr, size, 0);
+		blue.setLevel(bluePtr, size, 0);
+		tileNormalsPyramid.setLevel(tileNormals, tileSize*tileSize, 0);
+		unsigned char* tileBuffer = new unsigned char[tileSize*tileSize*4];
+		QSize tileMipMapSize[MIP_MAPPING_LEVELS];
+
+		#pragma omp for schedule(dynamic)
+		for (int t = 0; t < tilesX*tilesY; t++)
+		{
+			int tx = (t % tilesX)*tileSize;
+			int ty = (t / tilesX)*tileSize;
+			int tw = qMin(tileSize, info.width - tx);
+			int th = qMin(tileSize, info.height - ty);
+			int x0 = info.offx + tx;
+			int y0 = info.offy + ty;
+			quantizedLevel.dequantize(0, x0, y0, tw, th, redPtr);
+			quantizedLevel.dequantize(1, x0, y0, tw, th, greenPtr);
+			quantizedLevel.dequantize(2, x0, y0, tw, th, bluePtr);
+			if (readNormals)
+				normals.unpack(0, QRect(x0, y0, tw, th), tileNormals);
+
+			tileMipMapSize[0] = QSize(tw, th);
+			RenderingInfo tileInfo = {0, 0, th, tw, 0, info.mode, info.light, ordlen};
+			mode->applyHSH(red, green, blue, tileMipMapSize, tileNormalsPyramid, tileInfo, tileBuffer);
+
+			for (int j = 0; j < th; j++)
+				memcpy(buffer + ((ty + j)*info.width + tx)*4, tileBuffer + j*tw*4, tw*4);
+		}
+		delete[] tileBuffer;
+	}
 }
 
 
@@ -423,6 +659,8 @@ int Hsh::loadCompressed(QString name)
 int Hsh::loadCompressed(int xinf, int yinf, int xsup, int ysup, QString name)
 {
 	remote = false;
+	if (!quantizedLevel.isEmpty())
+		return -1;
 	Jpeg2000 jpegimage(name.toStdString().c_str());
 	int offset,offset2;
 	const float** coeffPtr = new const float*[ordlen*bands];
@@ -487,11 +725,24 @@ int Hsh::saveCompressed(int xinf, int yinf, int xsup, int ysup, int reslevel, QS
 	const float* rPtr = redCoefficients.getLevel(reslevel);
 	const float* gPtr = greenCoefficients.getLevel(reslevel);
 	const float* bPtr = blueCoefficients.getLevel(reslevel);
+	// The rows of a quantized level are dequantized one at a time.
+	const bool fromQuantized = reslevel == 0 && !quantizedLevel.isEmpty();
+	float* row = fromQuantized ? new float[tilew*ordlen*3] : NULL;
 
 	for (int y = yinf; y < ysup; y++)
+	{
+		if (fromQuantized)
+		{
+			quantizedLevel.dequantize(0, xinf, y, tilew, 1, row);
+			quantizedLevel.dequantize(1, xinf, y, tilew, 1, row + tilew*ordlen);
+			quantizedLevel.dequantize(2, xinf, y, tilew, 1, row + tilew*ordlen*2);
+			rPtr = row;
+			gPtr = row + tilew*ordlen;
+			bPtr = row + tilew*ordlen*2;
+		}
 		for (int x = xinf; x < xsup; x++)
 		{
-			offset = x + y * ww;
+			offset = fromQuantized ? x - xinf : x + y * ww;
 			offset2 = (x-xinf) + (y-yinf) * tilew;
 			for (int k = 0; k < ordlen; k++)
 			{
@@ -500,6 +751,9 @@ int Hsh::saveCompressed(int xinf, int yinf, int xsup, int ysup, int reslevel, QS
 				comps[ordlen*2 + k][offset2] = ((bPtr[offset*ordlen + k] - gmax[k])/gmin[k] * 255.0);
 			}
 		}
+	}
+	if (row)
+		delete[] row;
 
 	// Saves as a JPEG2000 image with 27 gray components of 16 bit each
 	Jpeg2000 jpegimage(tilew, tileh, 16, 16, ordlen*bands, comps, GRAY_CLRSPC, J2K_CFMT);
@@ -553,6 +807,11 @@ int Hsh::createImage(unsigned char** buffer, int& width, int& height, const vcg:
 		else
 			level = maxRemoteResolution - minRemoteResolution;
 	}
+
+	// While the image is loaded progressively the rendering falls back to the finest level ready.
+	QMutexLocker locker(&levelsLock);
+	if (level < readyLevel)
+		level = readyLevel;
 	for (int i = 0; i < level; i++)
 	{
 		width = ceil(width/2.0);
@@ -562,9 +821,22 @@ int Hsh::createImage(unsigned char** buffer, int& width, int& height, const vcg:
 	}
 	(*buffer) = new unsigned char[width*height*4];
 
+    // Computes the normals read by the current rendering mode, the first time they are needed.
+    RenderingMode* rendering = list->value(currentRendering);
+    if (rendering->normalsUsage() == ALL_NORMALS)
+    {
+        for (int i = readyLevel; i < MIP_MAPPING_LEVELS; i++)
+            calcNormals(i, QRect(QPoint(0, 0), mipMapSize[i]));
+    }
+    else if (rendering->normalsUsage() == VIEW_NORMALS)
+        calcNormals(level, QRect(offx, offy, width, height));
+
     // Applies the current rendering mode.
     RenderingInfo info = {offx, offy, height, width, level, mode, light, ordlen};
-    list->value(currentRendering)->applyHSH(redCoefficients, greenCoefficients, blueCoefficients, mipMapSize, normals, info, (*buffer));
+    if (level == 0 && !quantizedLevel.isEmpty())
+        renderQuantized(info, (*buffer));
+    else
+        rendering->applyHSH(redCoefficients, greenCoefficients, blueCoefficients, mipMapSize, normals, info, (*buffer));
 
 #ifdef PRINT_DEBUG
 	QTime second = QTime::currentTime();
@@ -595,6 +867,13 @@ QImage* Hsh::createPreview(int width, int height)
 			break;
 		}
 	}
+	QMutexLocker locker(&levelsLock);
+	if (level < readyLevel || (level == 0 && !quantizedLevel.isEmpty()))
+	{
+		level = qMax(readyLevel, 1);
+		imageH = mipMapSize[level].height();
+		imageW = mipMapSize[level].width();
+	}
 
 	
 	// Creates the preview.
@@ -605,7 +884,7 @@ QImage* Hsh::createPreview(int width, int height)
 	const float* greenPtr = greenCoefficients.getLevel(level);
 	const float* bluePtr = blueCoefficients.getLevel(level);
 	int tempW = mipMapSize[level].width();
-        float hweights[16];
+        float hweights[HSH_MAX_TERMS];
         float phi = 0.0f;
         float theta = acos(1.0);
     getHSH(theta, phi, hweights, sqrt((float)ordlen));
@@ -749,10 +1028,10 @@ int Hsh::loadCompressedHttp(QBuffer* b, int xinf, int yinf, int xsup, int ysup,
 	Eigen::Vector3d l0(sin(M_PI/4)*cos(M_PI/6), sin(M_PI/4)*sin(M_PI/6), cos(M_PI/4));
 	Eigen::Vector3d l1(sin(M_PI/4)*cos(5*M_PI / 6), sin(M_PI/4)*sin(5*M_PI / 6), cos(M_PI/4));
 	Eigen::Vector3d l2(sin(M_PI/4)*cos(3*M_PI / 2), sin(M_PI/4)*sin(3*M_PI / 2), cos(M_PI/4));
-    float hweights0[16], hweights1[16], hweights2[16];
-	getHSH(M_PI / 4, M_PI / 6, hweights0, ordlen);
-	getHSH(M_PI / 4, 5*M_PI / 6, hweights1, ordlen);
-	getHSH(M_PI / 4, 3*M_PI / 2, hweights2, ordlen);
+    float hweights0[HSH_MAX_TERMS], hweights1[HSH_MAX_TERMS], hweights2[HSH_MAX_TERMS];
+	getHSH(M_PI / 4, M_PI / 6, hweights0, sqrt((float)ordlen));
+	getHSH(M_PI / 4, 5*M_PI / 6, hweights1, sqrt((float)ordlen));
+	getHSH(M_PI / 4, 3*M_PI / 2, hweights2, sqrt((float)ordlen));
 	
 	Eigen::Matrix3d L;
 	L.setIdentity();
@@ -37,6 +37,7 @@
 #include "defaultrendering.h"
 #include "specularenhanc.h"
 #include "normalsrendering.h"
+#include "quantizedlevel.h"
 
 #include <jpeg2000.h>
 
@@ -44,6 +45,23 @@
 #include <QFile>
 #include <QImage>
 #include <QVector>
+#include <QMutex>
+
+
+/*!
+  Size in bytes of the bands of rows read with a single fread by Hsh::loadData.
+*/
+#define HSH_LOAD_BAND_BYTES (8 << 20)
+
+/*!
+  Number of pixels from which the finest level is kept quantized instead of expanded to floats.
+*/
+#define HSH_QUANTIZED_MIN_PIXELS (16 << 20)
+
+/*!
+  Side of the square tiles dequantized and rendered at a time from the quantized level.
+*/
+#define HSH_RENDER_TILE_SIZE 128
 
 
 //! HSH class
@@ -59,13 +77,17 @@ protected:
 	PyramidCoeffF greenCoefficients; /*!< Coefficients for green component. */
 	PyramidCoeffF blueCoefficients; /*!< Coefficients for blue component. */
 
-	float gmin[9]; /*!< Min coefficient value. */
-	float gmax[9]; /*!< Max coefficient value. */
+	float gmin[HSH_MAX_TERMS]; /*!< Min coefficient value. */
+	float gmax[HSH_MAX_TERMS]; /*!< Max coefficient value. */
 
 	int bands; /*!< Number of colors. */
 	int ordlen; /*!< Number of cofficients per pixel. */
 
-	PyramidNormals normals; /*!< Normals. */
+	LazyNormals normals; /*!< Normals, computed on demand. The level 0 of a quantized image is packed. */
+
+	QuantizedLevel quantizedLevel; /*!< Quantized finest level, used in place of the level 0 of the coefficients for large images. */
+
+	QMutex levelsLock; /*!< Lock between the rendering and the loading thread of a progressive load. */
 
 public:
 
@@ -78,12 +100,40 @@ public:
 	// protected methods
 protected:
 
-	
+	/*!
+	  Opens the file and reads its header, without changing the members.
+	  \param width width of the image.
+	  \param height height of the image.
+	  \param colors number of colors per pixel.
+	  \param order order of the HSH, the square root of the coefficients per pixel.
+	  \return the file positioned at the min and max values of the coefficients, NULL if the file is invalid.
+	*/
+	FILE* openHsh(int& width, int& height, int& colors, int& order);
+
+	/*!
+	  Computes the normals of the tiles of a mip-mapping level, intersecting a rectangle, not computed yet.
+	  \param level index of mip-mapping level.
+	  \param rect rectangle of the level.
+	*/
+	void calcNormals(int level, const QRect& rect);
+
+	/*!
+	  Computes the level 1 of the coefficients from the quantized level.
+	*/
+	void mipMapQuantized();
+
+	/*!
+	  Renders a sub-image of the quantized level, dequantizing it one tile at a time.
+	  \param info rendering info of the sub-image.
+	  \param buffer output buffer.
+	*/
+	void renderQuantized(const RenderingInfo& info, unsigned char* buffer);
 	
 public:
 
 	virtual int load(CallBackPos * cb = 0);
 	virtual int load(QString name, CallBackPos * cb = 0);
+	virtual int loadCoarse(CallBackPos * cb = 0);
 	virtual int save(QString name);
 	virtual int loadCompressed();
 	virtual int loadCompressed(QString name);
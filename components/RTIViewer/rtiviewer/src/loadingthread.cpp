@@ -0,0 +1,80 @@
+/****************************************************************************
+* RTIViewer                                                         o o     *
+* Single and Multi-View Reflectance Transformation Image Viewer   o     o   *
+*                                                                _   O  _   *
+* Copyright	(C) 2008-2010                                          \/)\/    *
+* Visual Computing Lab - ISTI CNR					              /\/|      *
+* and											                     |      *
+* Cultural Heritage Imaging							                 \      *
+*																			*
+* This program is free software: you can redistribute it and/or modify		*
+* it under the terms of the GNU General Public License as published by		*
+* the Free Software Foundation, either version 3 of the License, or			*
+* (at your option) any later version.										*
+*																			*
+* This program is distributed in the hope that it will be useful,			*
+* but WITHOUT ANY WARRANTY; without even the implied warranty of			*
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the				*
+* GNU General Public License for more details.								*
+*																			*
+* You should have received a copy of the GNU General Public License			*
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.		*
+****************************************************************************/
+
+#include "loadingthread.h"
+
+#include <new>
+
+LoadingThread* LoadingThread::current = NULL;
+
+
+LoadingThread::LoadingThread(QObject* parent) : QThread(parent),
+	image(NULL),
+	readyLevel(0)
+{
+	qRegisterMetaType<Rti*>("Rti*");
+}
+
+
+LoadingThread::~LoadingThread()
+{
+	wait();
+}
+
+
+void LoadingThread::load(Rti* rti)
+{
+	wait();
+	image = rti;
+	readyLevel = rti->finestReadyLevel();
+	current = this;
+	start(QThread::LowPriority);
+}
+
+
+bool LoadingThread::QCallBack(int pos, QString str)
+{
+	if (current && current->image && current->image->finestReadyLevel() != current->readyLevel)
+	{
+		current->readyLevel = current->image->finestReadyLevel();
+		emit current->levelReady();
+	}
+	return true;
+}
+
+
+void LoadingThread::run()
+{
+	int result;
+	try
+	{
+		result = image->load(QCallBack);
+	}
+	catch (std::bad_alloc&)
+	{
+		result = -2;
+	}
+	Rti* rti = image;
+	image = NULL;
+	emit loaded(rti, result);
+}
@@ -0,0 +1,96 @@
+/****************************************************************************
+* RTIViewer                                                         o o     *
+* Single and Multi-View Reflectance Transformation Image Viewer   o     o   *
+*                                                                _   O  _   *
+* Copyright	(C) 2008-2010                                          \/)\/    *
+* Visual Computing Lab - ISTI CNR					              /\/|      *
+* and											                     |      *
+* Cultural Heritage Imaging							                 \      *
+*																			*
+* This program is free software: you can redistribute it and/or modify		*
+* it under the terms of the GNU General Public License as published by		*
+* the Free Software Foundation, either version 3 of the License, or			*
+* (at your option) any later version.										*
+*																			*
+* This program is distributed in the hope that it will be useful,			*
+* but WITHOUT ANY WARRANTY; without even the implied warranty of			*
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the				*
+* GNU General Public License for more details.								*
+*																			*
+* You should have received a copy of the GNU General Public License			*
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.		*
+****************************************************************************/
+
+#ifndef LOADINGTHREAD_H
+#define LOADINGTHREAD_H
+
+#include "rti.h"
+
+#include <QThread>
+
+//! Thread for the progressive loading.
+/*!
+  The thread loads the full resolution of an image already opened with Rti::loadCoarse,
+  while the browser renders the finest mip-mapping level ready.
+*/
+class LoadingThread: public QThread
+{
+
+	Q_OBJECT
+
+// private data members
+private:
+
+	Rti* image; /*!< Image to load. */
+	int readyLevel; /*!< Finest mip-mapping level ready at the last update. */
+
+	static LoadingThread* current; /*!< Thread running the load, used by the static callback. */
+
+public:
+
+	//! Constructor.
+	LoadingThread(QObject* parent = 0);
+
+	//! Deconstructor.
+	~LoadingThread();
+
+	/*!
+	  Starts the loading of the full resolution of \a rti.
+	*/
+	void load(Rti* rti);
+
+	/*!
+	  Returns the image in loading, NULL if the thread is idle.
+	*/
+	Rti* getImage() {return image;}
+
+	/*!
+	  Static callback invoked by the image during the load.
+	  \param pos value of the progress.
+	  \param str label.
+	*/
+	static bool QCallBack(int pos, QString str);
+
+protected:
+
+	/*!
+	  Main function of the thread.
+	*/
+	void run();
+
+signals:
+
+	/*!
+	  Emitted when a finer mip-mapping level is ready to render.
+	*/
+	void levelReady();
+
+	/*!
+	  Emitted when the load is ended.
+	  \param rti loaded image.
+	  \param result value returned by Rti::load.
+	*/
+	void loaded(Rti* rti, int result);
+};
+
+#endif /* LOADINGTHREAD_H */
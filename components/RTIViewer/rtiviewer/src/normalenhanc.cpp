@@ -122,6 +122,11 @@ bool NormalEnhancement::enabledLighting()
 	return true;
 }
 
+int NormalEnhancement::normalsUsage()
+{
+	return ALL_NORMALS;
+}
+
 float NormalEnhancement::getGain()
 {
     // Get gain as a value normalized to the range [0,100]
@@ -65,6 +65,11 @@ bool NormalsRendering::enabledLighting()
     return false;
 }
 
+int NormalsRendering::normalsUsage()
+{
+    return VIEW_NORMALS;
+}
+
 void NormalsRendering::applyPtmLRGB(const PyramidCoeff& coeff, const PyramidRGB& rgb, const QSize* mipMapSize, const PyramidNormals& normals, const RenderingInfo& info, unsigned char* buffer)
 {
     renderNormals(mipMapSize, normals, info, buffer);
@@ -237,31 +237,10 @@ int RGBPtm::loadData(FILE* file, int width, int height, int basisTerm, bool urti
 	greenCoefficients.setLevel(greenCoeff, w*h, 0);
 	blueCoefficients.setLevel(blueCoeff, w*h, 0);
 	if (cb != NULL)	(*cb)(45, "Mip mapping generation...");
-	generateMipMap(1, w, h, cb, 45, 15);
+	generateMipMap(cb, 45, 15);
 
-	// Computes the normals
-	calculateNormals(normals, redCoefficients, true, cb, 60, 10);
-	calculateNormals(normals, greenCoefficients, false, cb, 70, 10);
-	calculateNormals(normals, blueCoefficients, false, cb, 80, 10);
-	for(int level = 0; level < MIP_MAPPING_LEVELS; level++)
-	{
-		int lenght = normals.getLevelLenght(level);
-		vcg::Point3f* tempNormals = new vcg::Point3f[lenght];
-		memcpy(tempNormals, normals.getLevel(level), sizeof(vcg::Point3f)*lenght);
-		int th_id = 0;
-		#pragma omp parallel for
-		for (int i = 0; i < lenght; i++)
-		{
-			th_id = omp_get_thread_num();
-			if (th_id == 0)
-			{
-				if (cb != NULL && i%500 == 0)	(*cb)(90 + level*2.5 + 2.5 * i / lenght, "Normals generation...");
-			}
-			tempNormals[i] /= 3;
-			tempNormals[i].Normalize();
-		}
-		normals.setLevel(tempNormals, lenght, level);
-	}
+	// The normals are computed on demand by the rendering modes that read them.
+	normals.setLazy(mipMapSize);
 
 	return 0;
 }
@@ -367,9 +346,12 @@ int RGBPtm::createImage(unsigned char** buffer, int& width, int& height, const v
 	}
 	else
 	{
-		// Applies the current rendering mode.
+		// Computes the normals read by the current rendering mode and applies it.
+		RenderingMode* rendering = list->value(currentRendering);
+		const PyramidCoeff* coeff[3] = {&redCoefficients, &greenCoefficients, &blueCoefficients};
+		updateNormals(normals, coeff, 3, rendering->normalsUsage(), level, QRect(offx, offy, width, height));
 		RenderingInfo info = {offx, offy, height, width, level, mode, light, 6};
-		list->value(currentRendering)->applyPtmRGB(redCoefficients, greenCoefficients, blueCoefficients, mipMapSize, normals, info, (*buffer));
+		rendering->applyPtmRGB(redCoefficients, greenCoefficients, blueCoefficients, mipMapSize, normals, info, (*buffer));
 	}
 	
 #ifdef PRINT_DEBUG
@@ -465,36 +447,11 @@ void RGBPtm::allocateSubLevel(int level, int w, int h)
 }
 
 
-void RGBPtm::calculateMipMap(int pos, int level, int i1)
+void RGBPtm::generateMipMap(CallBackPos * cb, int offset, int limit)
 {
-	for (int k = 0; k < 6; k++)
-	{
-		redCoefficients.calcMipMapping(level, pos*6 + k, i1 * 6 + k);
-		greenCoefficients.calcMipMapping(level, pos*6 + k, i1 * 6 + k);
-		blueCoefficients.calcMipMapping(level, pos*6 + k, i1 * 6 + k);
-	}
-}
-
-
-void RGBPtm::calculateMipMap(int pos, int level, int i1, int i2)
-{
-	for (int k = 0; k < 6; k++)
-	{
-		redCoefficients.calcMipMapping(level, pos*6 + k, i1 * 6 + k, i2*6 + k );
-		greenCoefficients.calcMipMapping(level, pos*6 + k, i1 * 6 + k, i2*6 + k);
-		blueCoefficients.calcMipMapping(level, pos*6 + k, i1 * 6 + k, i2*6 + k);
-	}
-}
-
-
-void RGBPtm::calculateMipMap(int pos, int level, int i1, int i2, int i3, int i4)
-{
-	for (int k = 0; k < 6; k++)
-	{
-		redCoefficients.calcMipMapping(level, pos*6 + k, i1 * 6 + k, i2*6 + k, i3*6 + k, i4*6 + k);
-		greenCoefficients.calcMipMapping(level, pos*6 + k, i1 * 6 + k, i2*6 + k, i3*6 + k, i4*6 + k);
-		blueCoefficients.calcMipMapping(level, pos*6 + k, i1 * 6 + k, i2*6 + k, i3*6 + k, i4*6 + k);
-	}
+	redCoefficients.buildMipMap(1, mipMapSize, cb, offset, limit/3);
+	greenCoefficients.buildMipMap(1, mipMapSize, cb, offset + limit/3, limit/3);
+	blueCoefficients.buildMipMap(1, mipMapSize, cb, offset + 2*limit/3, limit/3);
 }
 
 
@@ -691,10 +648,10 @@ int LRGBPtm::loadData(FILE* file, int width, int height, int basisTerm, bool urt
 	coefficients.setLevel(coeffPtr, w*h, 0);
 	rgb.setLevel(rgbPtr, w*h*3, 0);
 	
-	// Computes mip-mapping and normals.
+	// Computes mip-mapping. The normals are computed on demand.
 	if (cb != NULL)	(*cb)(55, "Mip mapping generation...");
-    generateMipMap(1, w, h, cb, 55, 20);
-    calculateNormals(normals, coefficients, true, cb, 75, 20);
+    generateMipMap(cb, 55, 20);
+    normals.setLazy(mipMapSize);
     return 0;
 }
 
@@ -920,9 +877,12 @@ int LRGBPtm::createImage(unsigned char** buffer, int& width, int& height, const
 	}
 	else
 	{
-		// Applies the current rendering mode.
+		// Computes the normals read by the current rendering mode and applies it.
+		RenderingMode* rendering = list->value(currentRendering);
+		const PyramidCoeff* coeff[1] = {&coefficients};
+		updateNormals(normals, coeff, 1, rendering->normalsUsage(), level, QRect(offx, offy, width, height));
 		RenderingInfo info = {offx, offy, height, width, level, mode, light, 6};
-		list->value(currentRendering)->applyPtmLRGB(coefficients, rgb, mipMapSize, normals, info, (*buffer));
+		rendering->applyPtmLRGB(coefficients, rgb, mipMapSize, normals, info, (*buffer));
 	}
 
 #ifdef PRINT_DEBUG
@@ -1114,30 +1074,10 @@ void LRGBPtm::allocateSubLevel(int level, int w, int h)
 }
 
 
-void LRGBPtm::calculateMipMap(int pos, int level, int i1)
-{
-	for (int k = 0; k < 6; k++)
-		coefficients.calcMipMapping(level, pos*6 + k, i1*6 +k);
-	for (int k = 0; k < 3; k++)
-		rgb.calcMipMapping(level, pos*3 + k, i1*3 + k);
-}
-
-
-void LRGBPtm::calculateMipMap(int pos, int level, int i1, int i2)
-{
-	for (int k = 0; k < 6; k++)
-		coefficients.calcMipMapping(level, pos*6 + k, i1*6 +k, i2*6 +k);
-	for (int k = 0; k < 3; k++)
-		rgb.calcMipMapping(level, pos*3 + k, i1*3 + k, i2*3 +k);
-}
-
-
-void LRGBPtm::calculateMipMap(int pos, int level, int i1, int i2, int i3, int i4)
+void LRGBPtm::generateMipMap(CallBackPos * cb, int offset, int limit)
 {
-	for (int k = 0; k < 6; k++)
-		coefficients.calcMipMapping(level, pos*6 + k, i1*6 +k, i2*6 +k, i3*6 +k, i4*6 +k);
-	for (int k = 0; k < 3; k++)
-		rgb.calcMipMapping(level, pos*3 + k, i1*3 + k, i2*3 +k, i3*3 +k, i4*3 +k);
+	coefficients.buildMipMap(1, mipMapSize, cb, offset, limit*2/3);
+	rgb.buildMipMap(1, mipMapSize, 3, 3, cb, offset + limit*2/3, limit/3);
 }
 
 
@@ -1428,9 +1368,8 @@ int JPEGLRGBPtm::load(QString name, CallBackPos *cb)
 	coefficients.setLevel(coeffPtr, w*h*6, 0);
 	rgb.setLevel(rgbPtr, w*h*3, 0);
 	if (cb != NULL)	(*cb)(70, "Calulation mip mapping...");
-	generateMipMap(1, w, h, cb, 70, 10);
-	if (cb != NULL)	(*cb)(80, "Calculation normals...");
-	calculateNormals(normals, coefficients, true, cb, 80, 18);
+	generateMipMap(cb, 70, 10);
+	normals.setLazy(mipMapSize);
 	for(int i = 0; i < 9; i++)
 	{
 		delete[] plane[i];
@@ -171,111 +171,74 @@ protected:
 
 
 	/*!
-	  Computes the normals per pixel.
+	  Computes the normals of the tiles of a mip-mapping level, intersecting a rectangle, not computed yet.
+	  With more components the normal is the normalized average of their normals.
 	  \param norm normals pyramid.
-	  \param coeff coefficient.
-	  \param lrgb flag to discriminate between LRGB and RGB.
-	  \param cb callback to update the progress bar.
-	  \param offset initial value of the progress bar.
-	  \param limit maximum increment for the progress bar value.
+	  \param coeff coefficients of the components.
+	  \param n number of components.
+	  \param level index of mip-mapping level.
+	  \param rect rectangle of the level.
 	*/
-	void calculateNormals(PyramidNormals& norm, const PyramidCoeff& coeff, bool lrgb = true, CallBackPos * cb = 0, int offset = 0, int limit = 0)
+	void calculateNormals(LazyNormals& norm, const PyramidCoeff* const* coeff, int n, int level, const QRect& rect)
 	{
-		if (cb != NULL)	(*cb)(offset, "Normals generation...");
-		for (int level = 0; level < MIP_MAPPING_LEVELS; level++)
+		const QVector<QRect> tiles = norm.missingTiles(level, rect);
+		if (tiles.isEmpty())
+			return;
+		vcg::Point3f* normalsLevel = norm.levelData(level);
+		const int width = mipMapSize[level].width();
+		#pragma omp parallel for schedule(dynamic)
+		for (int t = 0; t < tiles.size(); t++)
 		{
-			QSize size = mipMapSize[level];
-			const PTMCoefficient* coeffLevel = coeff.getLevel(level);
-            int lenght = size.width()*size.height();
-			vcg::Point3f* normalsLevel = new vcg::Point3f[lenght];
-			if (!lrgb)
-				memcpy(normalsLevel, norm.getLevel(level), sizeof(vcg::Point3f)*lenght);
-			int th_id;
-			#pragma omp parallel for
-			for (int j = 0; j < size.height(); j++)
+			const QRect& tile = tiles.at(t);
+			for (int j = tile.top(); j <= tile.bottom(); j++)
 			{
-				th_id = omp_get_thread_num();
-				if (th_id == 0)
+				for (int i = tile.left(); i <= tile.right(); i++)
 				{
-					if (cb != NULL && (j % 50 == 0)) (*cb)(offset + level*limit/4.0 + limit/4.0 * j / size.height(), "Normals generation...");
-				}
-				for (int i = 0; i < size.width(); i++)
-				{
-					int offset = j * size.width() + i;
-					vcg::Point3f temp = calculateNormal(&(coeffLevel[offset][0]));
-					if (lrgb)
-						normalsLevel[offset] = temp;
-					else
-						normalsLevel[offset] += temp;
+					int offset = j * width + i;
+					vcg::Point3f temp = calculateNormal(&(coeff[0]->getLevel(level)[offset][0]));
+					if (n > 1)
+					{
+						for (int c = 1; c < n; c++)
+							temp += calculateNormal(&(coeff[c]->getLevel(level)[offset][0]));
+						temp /= n;
+						temp.Normalize();
+					}
+					normalsLevel[offset] = temp;
 				}
 			}
-			norm.setLevel(normalsLevel, lenght, level);
 		}
 	}
 
 
 	/*!
-	  Computes a specific mip-mapping level.
-	  \param level mip-mapping level to compute.
-	  \param width width of the previus level.
-	  \param height height of the previus level.
-	  \param cb callback to update the progress bar.
-	  \param offset initial value of the progress bar.
-	  \param limit maximum increment for the progress bar value.
+	  Computes the normals read by a rendering mode, the first time they are needed.
+	  \param norm normals pyramid.
+	  \param coeff coefficients of the components.
+	  \param n number of components.
+	  \param usage value of NormalsUsage returned by the rendering mode.
+	  \param level index of the rendered mip-mapping level.
+	  \param rect rendered rectangle of the level.
 	*/
-	void generateMipMap(int level, int width, int height, CallBackPos * cb = 0, int offset = 0, int limit = 0)
+	void updateNormals(LazyNormals& norm, const PyramidCoeff* const* coeff, int n, int usage, int level, const QRect& rect)
 	{
-        if (level > 3) return;
-		int width2 = ceil(width/2.0);
-		int height2 = ceil(height/2.0);
-        allocateSubLevel(level, width2, height2);
-		int th_id;
-        #pragma omp parallel for
-        for (int i = 0; i < height - 1; i+=2)
-		{
-			th_id = omp_get_thread_num();
-			if (th_id == 0)
-			{
-				if (cb != NULL && (i % 50 == 0)) (*cb)(offset + static_cast<float>(i*(limit/2.0)/height), "Mip mapping generation...");
-			}
-			for (int j = 0; j < width - 1; j+=2)
-			{
-				int index1 = (i * width + j);
-				int index2 = (i * width + j + 1);
-				int index3 = ((i + 1) * width + j);
-				int index4 = ((i + 1) * width + j + 1);
-				int offset = (i/2 * width2 + j/2);
-				calculateMipMap(offset, level, index1, index2, index3, index4);
-			}
-		}
-        if (width2 % 2 != 0)
-		{
-			for (int i = 0; i < height - 1; i+=2)
-			{
-				int index1 = ((i + 1) * width - 1);
-				int index2 = ((i + 2) * width - 1);
-				int offset = ((i/2 + 1) * width2 - 1);
-				calculateMipMap(offset, level, index1, index2);
-			}
-		}
-		if (height % 2 != 0)
-		{
-			for (int i = 0; i < width - 1; i+=2)
-			{
-				int index1 = ((height - 1) * width + i);
-				int index2 = ((height - 1) * width + i + 1);
-				int offset = ((height2 - 1) * width2 + i/2);
-				calculateMipMap(offset, level, index1, index2);
-			}
-		}
-        if (height % 2 != 0 && width % 2 != 0)
+		if (usage == ALL_NORMALS)
 		{
-			calculateMipMap((height2*width2 - 1), level, (height * width -1));
+			for (int i = 0; i < MIP_MAPPING_LEVELS; i++)
+				calculateNormals(norm, coeff, n, i, QRect(QPoint(0, 0), mipMapSize[i]));
 		}
-        mipMapSize[level] = QSize(width2, height2);
-		generateMipMap(level+1, width2, height2, cb, offset + limit/2.0, limit/2.0);
+		else if (usage == VIEW_NORMALS)
+			calculateNormals(norm, coeff, n, level, rect);
 	}
 
+
+	/*!
+	  Computes the mip-mapping levels from the level 0, whose size is mipMapSize[0].
+	  \param cb callback to update the progress bar.
+	  \param offset initial value of the progress bar.
+	  \param limit maximum increment for the progress bar value.
+	*/
+	virtual void generateMipMap(CallBackPos * cb = 0, int offset = 0, int limit = 0) = 0;
+
 // public methods
 public:
 
@@ -290,21 +253,6 @@ private:
 	  \param h height of the level.
 	*/
 	virtual void allocateSubLevel(int level, int w, int h) = 0;
-	
-	/*!
-	  Computes mip-mapping.
-	*/
-	virtual void calculateMipMap(int pos, int level, int i1) = 0;
-	
-	/*!
-	  Computes mip-mapping.
-	*/
-	virtual void calculateMipMap(int pos, int level, int i1, int i2) = 0;
-	
-	/*!
-	  Computes mip-mapping.
-	*/
-	virtual void calculateMipMap(int pos, int level, int i1, int i2, int i3, int i4) = 0;
 
 //accessors
 public:
@@ -331,7 +279,7 @@ private:
 	PyramidCoeff greenCoefficients; /*!< Coefficients for green component. */
 	PyramidCoeff blueCoefficients; /*!< Coefficients for blue component. */
 
-	PyramidNormals normals; /*!< Normals. */
+	LazyNormals normals; /*!< Normals, computed on demand. */
 	
 // constructors
 public:
@@ -361,11 +309,11 @@ public:
 	virtual int loadData(FILE* file, int width, int height, int basisTerm, bool urti, CallBackPos * cb = 0,const QString& text = QString());
 	virtual void saveRemoteDescr(QString& filename, int level);
 
+protected:
+	virtual void generateMipMap(CallBackPos * cb = 0, int offset = 0, int limit = 0);
+
 private:
 	virtual void allocateSubLevel(int level, int w, int h);
-	virtual void calculateMipMap(int pos, int level, int i1);
-	virtual void calculateMipMap(int pos, int level, int i1, int i2);
-	virtual void calculateMipMap(int pos, int level, int i1, int i2, int i3, int i4);
 
 };
 
@@ -382,7 +330,7 @@ protected:
 
 	PyramidCoeff coefficients; /*!< Luminance coefficients. */
 	PyramidRGB rgb; /*!< RGB components. */
-	PyramidNormals normals; /*!< Normals. */
+	LazyNormals normals; /*!< Normals, computed on demand. */
 
 // constructor
 public:
@@ -411,11 +359,11 @@ public:
 	virtual int loadData(FILE* file, int width, int height, int basisTerm, bool urti, CallBackPos * cb = 0,const QString& text = QString());
 	virtual void saveRemoteDescr(QString& filename, int level);
 
+protected:
+	virtual void generateMipMap(CallBackPos * cb = 0, int offset = 0, int limit = 0);
+
 private:
 	virtual void allocateSubLevel(int level, int w, int h);
-	virtual void calculateMipMap(int pos, int level, int i1);
-	virtual void calculateMipMap(int pos, int level, int i1, int i2);
-	virtual void calculateMipMap(int pos, int level, int i1, int i2, int i3, int i4);
 
 };
 
@@ -30,6 +30,22 @@
 #include "ptmCoeffVectorized.h"
 
 #include <QDebug>
+#include <QSize>
+#include <QRect>
+#include <QVector>
+
+#include <omp.h>
+
+/*!
+  Side in pixels of the tiles of the finest level processed by the mip-mapping.
+  It must be a multiple of 2^MIP_MAPPING_LEVELS.
+*/
+#define MIP_MAPPING_TILE 64
+
+/*!
+  Side in pixels of the tiles whose normals are computed on demand.
+*/
+#define NORMALS_TILE 128
 
 //! Wrapper class for mip-mapping
 /*!
@@ -156,72 +172,117 @@ public:
 };
 
 
-//! Extension to calculate the mip-mapping.
 /*!
-  The class extends the \a Pyramid class to permit the calculation of the mip-mapping.
-  The class requires that the type \a T defines the operators '+' and '='.
+  Computes the sizes of \a nLevels mip-mapping levels: sizes[i] is half of sizes[i-1], rounded up.
+  \param sizes sizes of the levels; sizes[0] must be set.
+  \param nLevels number of levels to compute.
 */
-template <typename T, int nLevel>
-class MipMapPyramid: public Pyramid<T, nLevel>
+inline void mipMapSizes(QSize* sizes, int nLevels)
 {
+	for (int i = 1; i <= nLevels; i++)
+		sizes[i] = QSize((sizes[i - 1].width() + 1) / 2, (sizes[i - 1].height() + 1) / 2);
+}
 
-public:
-
-	/*!
-	  Sets the element of position \a offset and level \a level equal to the element of the level \a level-1 
-	  and position \a index1.  
-
-	  value[level][offset] = value[level -1][index1].
 
-	  \param level level of destination element.
-	  \param offset position of destination element.
-	  \param index1 positions of the level \a level-1.
-	*/
-	inline void calcMipMapping(int level, int offset, int index1)
+/*!
+  Computes the rows from \a y0 to \a y1 and the columns from \a x0 to \a x1 of a mip-mapping level.
+  Each element is the average of the 2x2 block of the previous level. On the odd edges the missing
+  row or column is replaced by the last one, that is the 2x1 or 1x2 block is averaged and the single
+  element in the odd corner is copied, with the same sums.
+*/
+template <typename T>
+inline void mipMapRegion(const T* src, const QSize& srcSize, T* dst, int dstWidth, int x0, int x1, int y0, int y1, int stride, int components)
+{
+	const int srcW = srcSize.width();
+	for (int y = y0; y < y1; y++)
 	{
-		if (level > 0) 
-			this->value[level][offset] = this->value[level -1][index1];
+		const T* row0 = src + (size_t)(2*y)*srcW*stride;
+		const T* row1 = 2*y + 1 < srcSize.height() ? row0 + (size_t)srcW*stride : row0;
+		T* out = dst + ((size_t)y*dstWidth + x0)*stride;
+		for (int x = x0; x < x1; x++, out += stride)
+		{
+			const int c0 = 2*x*stride;
+			const int c1 = 2*x + 1 < srcW ? c0 + stride : c0;
+			for (int k = 0; k < components; k++)
+				out[k] = static_cast<T>(((float)row0[c0 + k] + row0[c1 + k] + ((float)row1[c0 + k] + row1[c1 + k]))*0.25f);
+		}
 	}
+}
 
-	/*!
-	  Calculates the element of position \a offset and level \a level as average of two elements of the level \a level-1 
-	  and positions \a index1 and \a index2.  
-
-	  value[level][offset] = (value[level -1][index1] + value[level -1][index2])*0.5;	
-	  
-	  \param level level of destination element.
-	  \param offset position of destination element.
-	  \param index1, index2 positions of the level \a level-1.
-	*/
-	inline void calcMipMapping(int level, int offset, int index1, int index2)
+
+/*!
+  Computes \a nLevels mip-mapping levels from \a base in a single pass.
+  The finest level is split in tiles of MIP_MAPPING_TILE pixels, processed in parallel, and each tile
+  is reduced to all the coarser levels while it is still in cache.
+  \param base elements of the finest level.
+  \param levels arrays of the levels to compute.
+  \param nLevels number of levels to compute.
+  \param sizes sizes of \a base and of the \a nLevels levels (see mipMapSizes).
+  \param stride number of elements per pixel.
+  \param components number of elements per pixel to average.
+  \param cb callback to update the progress bar.
+  \param offset initial value of the progress bar.
+  \param limit maximum increment for the progress bar value.
+*/
+template <typename T>
+void mipMapLevels(const T* base, T* const* levels, int nLevels, const QSize* sizes, int stride, int components, CallBackPos* cb = 0, int offset = 0, int limit = 0)
+{
+	const int tilesX = (sizes[0].width() + MIP_MAPPING_TILE - 1) / MIP_MAPPING_TILE;
+	const int tilesY = (sizes[0].height() + MIP_MAPPING_TILE - 1) / MIP_MAPPING_TILE;
+	const int tiles = tilesX*tilesY;
+	#pragma omp parallel for schedule(dynamic)
+	for (int t = 0; t < tiles; t++)
 	{
-		if (level > 0) 
-			this->value[level][offset] = (this->value[level -1][index1] + this->value[level -1][index2])*0.5f;	
+		if (cb != NULL && t % tilesX == 0 && omp_get_thread_num() == 0)
+			(*cb)(offset + limit*t/tiles, "Mip mapping generation...");
+		const int tx = (t % tilesX)*MIP_MAPPING_TILE;
+		const int ty = (t / tilesX)*MIP_MAPPING_TILE;
+		const T* src = base;
+		for (int l = 1; l <= nLevels; l++)
+		{
+			int x1 = qMin((tx + MIP_MAPPING_TILE) >> l, sizes[l].width());
+			int y1 = qMin((ty + MIP_MAPPING_TILE) >> l, sizes[l].height());
+			mipMapRegion(src, sizes[l - 1], levels[l - 1], sizes[l].width(), tx >> l, x1, ty >> l, y1, stride, components);
+			src = levels[l - 1];
+		}
 	}
+}
 
 
+//! Extension to calculate the mip-mapping.
+/*!
+  The class extends the \a Pyramid class to permit the calculation of the mip-mapping.
+  The class requires that the type \a T converts to and from float.
+*/
+template <typename T, int nLevel>
+class MipMapPyramid: public Pyramid<T, nLevel>
+{
+
+public:
+
 	/*!
-	  Calculates the element of position \a offset and level \a level as average of four elements of the level \a level-1 
-	  and positions \a index1, \a index2, \a index3 and \a index4.  
-
-	  value[level][offset] = (value[level -1][index1] + value[level -1][index2] + value[level -1][index3] + value[level -1][index4])*0.25;	
-	  
-	  \param level level of destination element.
-	  \param offset position of destination element.
-	  \param index1, index2, index3, index4 positions of the level \a level-1.
+	  Allocates and computes the levels from \a first to \a nLevel-1 from the level \a first-1 in a single pass.
+	  \param first first level to compute.
+	  \param sizes sizes of the levels. The sizes from \a first on are computed.
+	  \param stride number of elements per pixel.
+	  \param components number of elements per pixel to average.
+	  \param cb callback to update the progress bar.
+	  \param offset initial value of the progress bar.
+	  \param limit maximum increment for the progress bar value.
 	*/
-	inline void calcMipMapping(int level, int offset, int index1, int index2, int index3, int index4)
+	void buildMipMap(int first, QSize* sizes, int stride, int components, CallBackPos* cb = 0, int offset = 0, int limit = 0)
 	{
-		if (level > 0) 
-			this->value[level][offset] = (this->value[level -1][index1] + this->value[level -1][index2] + this->value[level -1][index3] + this->value[level -1][index4])*0.25f;	
+		mipMapSizes(sizes + first - 1, nLevel - first);
+		for (int level = first; level < nLevel; level++)
+			this->allocateLevel(level, sizes[level].width()*sizes[level].height()*stride);
+		mipMapLevels(this->value[first - 1], this->value + first, nLevel - first, sizes + first - 1, stride, components, cb, offset, limit);
 	}
 
 };
 
 //! Extension to calculate the mip-mapping.
 /*!
-  The class extends the \a Pyramid class to permit the calculation of the mip-mapping.
-  The class requires that the type \a T defines the operators '+' and '='.
+  The class stores levels of PTM coefficients and permits the calculation of the mip-mapping.
 */
 template <int nLevel>
 class MipMapPyramidPTM
@@ -364,57 +425,23 @@ public:
 	}
 
 	/*!
-	  Sets the element of position \a offset and level \a level equal to the element of the level \a level-1 
-	  and position \a index1.  
-
-	  value[level][offset] = value[level -1][index1].
-
-	  \param level level of destination element.
-	  \param offset position of destination element.
-	  \param index1 positions of the level \a level-1.
+	  Allocates and computes the levels from \a first to \a nLevel-1 from the level \a first-1 in a single pass.
+	  \param first first level to compute.
+	  \param sizes sizes of the levels. The sizes from \a first on are computed.
+	  \param cb callback to update the progress bar.
+	  \param offset initial value of the progress bar.
+	  \param limit maximum increment for the progress bar value.
 	*/
-	inline void calcMipMapping(int level, int offset, int index1)
+	void buildMipMap(int first, QSize* sizes, CallBackPos* cb = 0, int offset = 0, int limit = 0)
 	{
-		int index = offset / 6;
-		int field = offset & 6;
-		if (level > 0) 
-			this->value[level][index][field] = this->value[level -1][index1/6][index%6];
-	}
-
-	/*!
-	  Calculates the element of position \a offset and level \a level as average of two elements of the level \a level-1 
-	  and positions \a index1 and \a index2.  
-
-	  value[level][offset] = (value[level -1][index1] + value[level -1][index2])*0.5;	
-	  
-	  \param level level of destination element.
-	  \param offset position of destination element.
-	  \param index1, index2 positions of the level \a level-1.
-	*/
-	inline void calcMipMapping(int level, int offset, int index1, int index2)
-	{
-		if (level > 0) 
-			this->value[level][offset/6][offset%6] = (this->value[level -1][index1/6][index1%6] + this->value[level -1][index2/6][index2%6])*0.5f;	
-	}
-
-
-	/*!
-	  Calculates the element of position \a offset and level \a level as average of four elements of the level \a level-1 
-	  and positions \a index1, \a index2, \a index3 and \a index4.  
-
-	  value[level][offset] = (value[level -1][index1] + value[level -1][index2] + value[level -1][index3] + value[level -1][index4])*0.25;	
-	  
-	  \param level level of destination element.
-	  \param offset position of destination element.
-	  \param index1, index2, index3, index4 positions of the level \a level-1.
-	*/
-	inline void calcMipMapping(int level, int offset, int index1, int index2, int index3, int index4)
-	{
-
-		int indexes[5][2] = {{offset/6,offset%6},{index1/6,index1%6},{index2/6,index2%6},{index3/6,index3%6},{index4/6,index4%6}};
-
-		if (level > 0) 
-			this->value[level][offset/6][offset%6] = (this->value[level -1][index1/6][index1%6] + this->value[level -1][index2/6][index2%6] + this->value[level -1][index3/6][index3%6] + this->value[level -1][index4/6][index4%6])*0.25f;	
+		int* levels[nLevel];
+		mipMapSizes(sizes + first - 1, nLevel - first);
+		for (int level = first; level < nLevel; level++)
+		{
+			allocateLevel(level, sizes[level].width()*sizes[level].height());
+			levels[level] = (int*)value[level];
+		}
+		mipMapLevels((const int*)value[first - 1], levels + first, nLevel - first, sizes + first - 1, sizeof(PTMCoefficient) / sizeof(int), 6, cb, offset, limit);
 	}
 
 };
@@ -439,4 +466,209 @@ typedef MipMapPyramid<unsigned char, MIP_MAPPING_LEVELS> PyramidRGB;
 */
 typedef Pyramid<vcg::Point3f, MIP_MAPPING_LEVELS> PyramidNormals;
 
+
+/*!
+  Encodes a unit vector in 16 bits with the octahedral mapping, 8 bits per coordinate.
+*/
+inline unsigned short octEncode(const vcg::Point3f& n)
+{
+	float s = fabs(n[0]) + fabs(n[1]) + fabs(n[2]);
+	float u = s > 0 ? n[0] / s : 0;
+	float v = s > 0 ? n[1] / s : 0;
+	if (n[2] < 0)
+	{
+		float tu = u;
+		u = (1 - fabs(v)) * (tu >= 0 ? 1 : -1);
+		v = (1 - fabs(tu)) * (v >= 0 ? 1 : -1);
+	}
+	int iu = static_cast<int>((u * 0.5f + 0.5f) * 255 + 0.5f);
+	int iv = static_cast<int>((v * 0.5f + 0.5f) * 255 + 0.5f);
+	return (qBound(0, iu, 255) << 8) | qBound(0, iv, 255);
+}
+
+
+/*!
+  Decodes a unit vector encoded by octEncode.
+*/
+inline vcg::Point3f octDecode(unsigned short code)
+{
+	float u = (code >> 8) / 127.5f - 1;
+	float v = (code & 0xff) / 127.5f - 1;
+	vcg::Point3f n(u, v, 1 - fabs(u) - fabs(v));
+	if (n[2] < 0)
+	{
+		n[0] = (1 - fabs(v)) * (u >= 0 ? 1 : -1);
+		n[1] = (1 - fabs(u)) * (v >= 0 ? 1 : -1);
+	}
+	return n.Normalize();
+}
+
+
+//! Extension to compute the normals on demand.
+/*!
+  The class extends the pyramid of the normals to compute them tile by tile, the first time a rendering
+  mode reads them, and to allocate a level only when its first tile is computed. A level can be stored
+  packed, 16 bits per normal with octEncode, and read with unpack in place of getLevel.
+  The levels set or allocated as a whole are complete.
+*/
+class LazyNormals: public PyramidNormals
+{
+
+private:
+
+	QSize sizes[MIP_MAPPING_LEVELS]; /*!< Sizes of the levels. */
+	QVector<bool> computed[MIP_MAPPING_LEVELS]; /*!< Computed tiles of the levels, empty for a complete level. */
+	bool packedLevel[MIP_MAPPING_LEVELS]; /*!< Holds whether the levels are packed. */
+	unsigned short* packed[MIP_MAPPING_LEVELS]; /*!< Packed levels. */
+
+public:
+
+	//! Constructor
+	LazyNormals()
+	{
+		for (int i = 0; i < MIP_MAPPING_LEVELS; i++)
+		{
+			packedLevel[i] = false;
+			packed[i] = NULL;
+		}
+	}
+
+	//! Deconstructor
+	~LazyNormals()
+	{
+		for (int i = 0; i < MIP_MAPPING_LEVELS; i++)
+			delete[] packed[i];
+	}
+
+	/*!
+	  Releases all levels, that will be computed on demand.
+	  \param mipMapSize sizes of the levels.
+	*/
+	void setLazy(const QSize* mipMapSize)
+	{
+		for (int level = 0; level < MIP_MAPPING_LEVELS; level++)
+		{
+			PyramidNormals::setLevel(NULL, 0, level);
+			delete[] packed[level];
+			packed[level] = NULL;
+			sizes[level] = mipMapSize[level];
+			int tilesX = (sizes[level].width() + NORMALS_TILE - 1) / NORMALS_TILE;
+			int tilesY = (sizes[level].height() + NORMALS_TILE - 1) / NORMALS_TILE;
+			computed[level] = QVector<bool>(tilesX*tilesY, false);
+		}
+	}
+
+	/*!
+	  Sets whether a level is stored packed. It must be called after setLazy and before the level is computed.
+	*/
+	void setPacked(int level, bool pack)
+	{
+		if (level < MIP_MAPPING_LEVELS)
+			packedLevel[level] = pack;
+	}
+
+	/*!
+	  Returns whether the level of index \a level is packed.
+	*/
+	bool isPacked(int level) const
+	{
+		return level < MIP_MAPPING_LEVELS && packedLevel[level];
+	}
+
+	/*!
+	  Sets a complete level. See Pyramid::setLevel.
+	*/
+	bool setLevel(vcg::Point3f* data, int l, int level)
+	{
+		if (level < MIP_MAPPING_LEVELS)
+		{
+			computed[level].clear();
+			packedLevel[level] = false;
+		}
+		return PyramidNormals::setLevel(data, l, level);
+	}
+
+	/*!
+	  Allocates a complete level. See Pyramid::allocateLevel.
+	*/
+	bool allocateLevel(int level, int l)
+	{
+		if (level < MIP_MAPPING_LEVELS)
+		{
+			computed[level].clear();
+			packedLevel[level] = false;
+		}
+		return PyramidNormals::allocateLevel(level, l);
+	}
+
+	/*!
+	  Returns the tiles of a level, intersecting a rectangle, whose normals are not computed yet, and marks them as
+	  computed. The level is allocated at the first request. The caller computes the normals of the returned tiles
+	  and stores them with levelData or pack.
+	  \param level index of mip-mapping level.
+	  \param rect rectangle of the level.
+	  \return the missing tiles, clipped to the level.
+	*/
+	QVector<QRect> missingTiles(int level, const QRect& rect)
+	{
+		QVector<QRect> tiles;
+		if (level >= MIP_MAPPING_LEVELS || computed[level].isEmpty())
+			return tiles;
+		const QRect bounds(QPoint(0, 0), sizes[level]);
+		const QRect r = rect.intersected(bounds);
+		if (r.isEmpty())
+			return tiles;
+		const int tilesX = (sizes[level].width() + NORMALS_TILE - 1) / NORMALS_TILE;
+		for (int ty = r.top() / NORMALS_TILE; ty <= r.bottom() / NORMALS_TILE; ty++)
+			for (int tx = r.left() / NORMALS_TILE; tx <= r.right() / NORMALS_TILE; tx++)
+			{
+				if (computed[level][ty*tilesX + tx])
+					continue;
+				computed[level][ty*tilesX + tx] = true;
+				tiles.append(QRect(tx*NORMALS_TILE, ty*NORMALS_TILE, NORMALS_TILE, NORMALS_TILE).intersected(bounds));
+			}
+		if (!tiles.isEmpty())
+		{
+			int l = sizes[level].width()*sizes[level].height();
+			if (packedLevel[level] && !packed[level])
+				packed[level] = new unsigned short[l];
+			else if (!packedLevel[level] && !value[level])
+				PyramidNormals::allocateLevel(level, l);
+		}
+		return tiles;
+	}
+
+	/*!
+	  Returns the normals of a level not packed, to store the normals of the tiles returned by missingTiles.
+	*/
+	vcg::Point3f* levelData(int level)
+	{
+		if (level < MIP_MAPPING_LEVELS)
+			return value[level];
+		return NULL;
+	}
+
+	/*!
+	  Stores the normals \a src of a rectangle of a packed level.
+	*/
+	void pack(int level, const QRect& rect, const vcg::Point3f* src)
+	{
+		const int width = sizes[level].width();
+		for (int y = rect.top(); y <= rect.bottom(); y++)
+			for (int x = rect.left(); x <= rect.right(); x++)
+				packed[level][y*width + x] = octEncode(*src++);
+	}
+
+	/*!
+	  Decodes in \a dst the normals of a rectangle of a level computed on demand, packed or not.
+	*/
+	void unpack(int level, const QRect& rect, vcg::Point3f* dst) const
+	{
+		const int width = sizes[level].width();
+		for (int y = rect.top(); y <= rect.bottom(); y++)
+			for (int x = rect.left(); x <= rect.right(); x++)
+				*dst++ = packedLevel[level] ? octDecode(packed[level][y*width + x]) : value[level][y*width + x];
+	}
+};
+
 #endif //PYRAMID_H
@@ -0,0 +1,132 @@
+/****************************************************************************
+* RTIViewer                                                         o o     *
+* Single and Multi-View Reflectance Transformation Image Viewer   o     o   *
+*                                                                _   O  _   *
+* Copyright	(C) 2008-2010                                          \/)\/    *
+* Visual Computing Lab - ISTI CNR					              /\/|      *
+* and											                     |      *
+* Cultural Heritage Imaging							                 \      *
+*																			*
+* This program is free software: you can redistribute it and/or modify		*
+* it under the terms of the GNU General Public License as published by		*
+* the Free Software Foundation, either version 3 of the License, or			*
+* (at your option) any later version.										*
+*																			*
+* This program is distributed in the hope that it will be useful,			*
+* but WITHOUT ANY WARRANTY; without even the implied warranty of			*
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the				*
+* GNU General Public License for more details.								*
+*																			*
+* You should have received a copy of the GNU General Public License			*
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.		*
+****************************************************************************/
+
+#include "quantizedlevel.h"
+
+/*====================================================================
+ *
+ * QuantizedLevel class
+ *
+ *===================================================================*/
+
+QuantizedLevel::QuantizedLevel() :
+	file(NULL),
+	mapped(NULL),
+	buffer(NULL),
+	data(NULL),
+	w(0),
+	h(0),
+	components(0),
+	terms(0)
+{
+}
+
+
+QuantizedLevel::~QuantizedLevel()
+{
+	clear();
+}
+
+
+bool QuantizedLevel::map(const QString& filename, qint64 offset, int width, int height, int comps, int nterms)
+{
+	clear();
+	if (filename.isEmpty() || nterms > HSH_MAX_TERMS)
+		return false;
+	qint64 size = (qint64)width * height * comps * nterms;
+	file = new QFile(filename);
+	if (!file->open(QIODevice::ReadOnly) || file->size() < offset + size)
+	{
+		clear();
+		return false;
+	}
+	mapped = file->map(offset, size);
+	if (mapped == NULL)
+	{
+		clear();
+		return false;
+	}
+	data = mapped;
+	w = width;
+	h = height;
+	components = comps;
+	terms = nterms;
+	return true;
+}
+
+
+unsigned char* QuantizedLevel::allocate(int width, int height, int comps, int nterms)
+{
+	clear();
+	if (nterms > HSH_MAX_TERMS)
+		return NULL;
+	buffer = new unsigned char[(size_t)width * height * comps * nterms];
+	data = buffer;
+	w = width;
+	h = height;
+	components = comps;
+	terms = nterms;
+	return buffer;
+}
+
+
+void QuantizedLevel::setDequantization(const float* s, const float* b)
+{
+	for (int k = 0; k < terms; k++)
+	{
+		scale[k] = s[k];
+		bias[k] = b[k];
+	}
+}
+
+
+void QuantizedLevel::clear()
+{
+	if (file)
+	{
+		if (mapped)
+			file->unmap(mapped);
+		file->close();
+		delete file;
+	}
+	if (buffer)
+		delete[] buffer;
+	file = NULL;
+	mapped = NULL;
+	buffer = NULL;
+	data = NULL;
+	w = h = components = terms = 0;
+}
+
+
+void QuantizedLevel::dequantize(int component, int x, int y, int width, int height, float* dst) const
+{
+	const int pixelSize = components * terms;
+	for (int j = 0; j < height; j++)
+	{
+		const unsigned char* src = data + ((size_t)(y + j) * w + x) * pixelSize + component * terms;
+		for (int i = 0; i < width; i++, src += pixelSize, dst += terms)
+			for (int k = 0; k < terms; k++)
+				dst[k] = src[k] * scale[k] + bias[k];
+	}
+}
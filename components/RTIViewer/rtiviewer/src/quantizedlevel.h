@@ -0,0 +1,119 @@
+/****************************************************************************
+* RTIViewer                                                         o o     *
+* Single and Multi-View Reflectance Transformation Image Viewer   o     o   *
+*                                                                _   O  _   *
+* Copyright	(C) 2008-2010                                          \/)\/    *
+* Visual Computing Lab - ISTI CNR					              /\/|      *
+* and											                     |      *
+* Cultural Heritage Imaging							                 \      *
+*																			*
+* This program is free software: you can redistribute it and/or modify		*
+* it under the terms of the GNU General Public License as published by		*
+* the Free Software Foundation, either version 3 of the License, or			*
+* (at your option) any later version.										*
+*																			*
+* This program is distributed in the hope that it will be useful,			*
+* but WITHOUT ANY WARRANTY; without even the implied warranty of			*
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the				*
+* GNU General Public License for more details.								*
+*																			*
+* You should have received a copy of the GNU General Public License			*
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.		*
+****************************************************************************/
+
+#ifndef QUANTIZEDLEVEL_H
+#define QUANTIZEDLEVEL_H
+
+#include "util.h"
+
+#include <QFile>
+#include <QString>
+
+/*====================================================================
+ *
+ * QuantizedLevel class header
+ *
+ *===================================================================*/
+
+//! Quantized storage of a mip-mapping level.
+/*!
+  The class keeps the coefficients of a level as the 8-bit values stored in the file and
+  dequantizes them on demand, a rectangle at a time. The values are mapped from the file
+  when the payload is a plain array of bytes, otherwise they are held in memory.
+  Each pixel stores \a components groups of \a terms coefficients.
+*/
+class QuantizedLevel
+{
+
+private:
+
+	QFile* file; /*!< Mapped file, if any. */
+	uchar* mapped; /*!< Start of the mapped region. */
+	unsigned char* buffer; /*!< Coefficients held in memory when the file is not mapped. */
+	const unsigned char* data; /*!< Quantized coefficients. */
+	int w; /*!< Width of the level. */
+	int h; /*!< Height of the level. */
+	int components; /*!< Number of components per pixel. */
+	int terms; /*!< Number of coefficients per component. */
+	float scale[HSH_MAX_TERMS]; /*!< Dequantization scale of each coefficient. */
+	float bias[HSH_MAX_TERMS]; /*!< Dequantization bias of each coefficient. */
+
+public:
+
+	//! Constructor.
+	QuantizedLevel();
+
+	//! Deconstructor.
+	~QuantizedLevel();
+
+	/*!
+	  Maps the level from the file \a filename.
+	  \param filename path of the file.
+	  \param offset position of the first coefficient in the file.
+	  \param width, height size of the level.
+	  \param comps number of components per pixel.
+	  \param nterms number of coefficients per component.
+	  \return true if the file is mapped, false otherwise.
+	*/
+	bool map(const QString& filename, qint64 offset, int width, int height, int comps, int nterms);
+
+	/*!
+	  Allocates the memory for a level that cannot be mapped.
+	  \param width, height size of the level.
+	  \param comps number of components per pixel.
+	  \param nterms number of coefficients per component.
+	  \return the array to fill with the quantized coefficients.
+	*/
+	unsigned char* allocate(int width, int height, int comps, int nterms);
+
+	/*!
+	  Sets the dequantization table, value = c * \a s[k] + \a b[k].
+	*/
+	void setDequantization(const float* s, const float* b);
+
+	/*!
+	  Releases the level.
+	*/
+	void clear();
+
+	/*!
+	  Returns true if the level holds no data.
+	*/
+	bool isEmpty() const {return data == NULL;}
+
+	/*!
+	  Returns true if the level is mapped from the file.
+	*/
+	bool isMapped() const {return mapped != NULL;}
+
+	/*!
+	  Dequantizes the component \a component of a rectangle of the level.
+	  \param component index of the component.
+	  \param x, y top-left corner of the rectangle.
+	  \param width, height size of the rectangle.
+	  \param dst output array of \a width * \a height * terms floats, coefficients of each pixel contiguous.
+	*/
+	void dequantize(int component, int x, int y, int width, int height, float* dst) const;
+};
+
+#endif /* QUANTIZEDLEVEL_H */
@@ -32,6 +32,17 @@
 #include <QWidget>
 #include <QDialog>
 
+//! Use of the normals.
+/*!
+  Enumeration of the normals read by a rendering mode, computed on demand by the image.
+*/
+enum NormalsUsage
+{
+	NO_NORMALS, /*!< The mode does not read the normals. */
+	VIEW_NORMALS, /*!< The mode reads the normals of the rendered sub-image. */
+	ALL_NORMALS, /*!< The mode reads the normals of all mip-mapping levels. */
+};
+
 //! Rendering mode abstract class
 /*!
   Abstract class for the rendering modes to apply to RTI image.
@@ -79,6 +90,12 @@ public:
 	*/
 	virtual bool enabledLighting() = 0;
 
+	/*!
+	  Returns info about the normals read by the rendering mode, that the image computes before the rendering.
+	  \return a value of NormalsUsage.
+	*/
+	virtual int normalsUsage() {return NO_NORMALS;}
+
 	/*!
 	  Applies the rendering mode to a LRGB-PTM.
 	  \param coeff luminance coefficients.
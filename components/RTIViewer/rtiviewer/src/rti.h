@@ -60,6 +60,8 @@ protected:
 
 	unsigned int* tiles; /*!< Info about the tiles loaded from the remote server. */
 
+	int readyLevel; /*!< Finest mip-mapping level ready to render while the image is loaded progressively. */
+
 
 //public method
 public:
@@ -69,6 +71,7 @@ public:
 		maxRemoteResolution(0),
 		minRemoteResolution(0),
 		tiles(NULL),
+		readyLevel(0),
 		list(NULL)
 	{ };
 
@@ -103,6 +106,15 @@ public:
 	*/
 	virtual int load(QString str, CallBackPos * cb = 0) = 0;
 
+
+	/*!
+	  Loads a decimated copy of the image, to render while the method load() reads the full
+	  image on another thread. The renderings fall back to the finest level ready.
+	  \param cb callback to update the progress bar.
+	  \return returns 0 if the coarse image was successfully loaded, returns -1 if the format doesn't support the progressive loading.
+	*/
+	virtual int loadCoarse(CallBackPos * cb = 0) {return -1;}
+
 	
 	/*!
 	  Saves the image.
@@ -289,6 +301,11 @@ public:
 	*/
 	QString typeFormat(){return type;}
 
+	/*!
+	  Returns the finest mip-mapping level ready to render, 0 when the image is fully loaded.
+	*/
+	int finestReadyLevel(){return readyLevel;}
+
 	/*!
 	  Reset the flag for the remote RTI image.
 	  The method must be invoked when all tiles are received. 
@@ -39,7 +39,8 @@ macx-g++:QMAKE_CFLAGS += -O3 -msse2 -fopenmp -funroll-loops -ffast-math -fforce-
 
 INCLUDEPATH += ../../../../vcglib \
     ../../compression/src/ \
-    ../../rtiwebmaker/src
+    ../../rtiwebmaker/src \
+    ../../../HSHfitter2/src
 
 SOURCES = ptm.cpp \
     gui.cpp \
@@ -51,6 +52,7 @@ SOURCES = ptm.cpp \
     specularenhanc.cpp \
     navigator.cpp \
     loadingdlg.cpp \
+    loadingthread.cpp \
     openremotedlg.cpp \
     httpthread.cpp \
     normalenhanc.cpp \
@@ -59,6 +61,7 @@ SOURCES = ptm.cpp \
     detailenhanc.cpp \
     dyndetailenhanc.cpp \
     hsh.cpp \
+    quantizedlevel.cpp \
     universalrti.cpp \
     multiviewrti.cpp \
     rendercontrolutils.cpp \
@@ -78,6 +81,7 @@ HEADERS = rti.h \
     specularenhanc.h \
     navigator.h \
     loadingdlg.h \
+    loadingthread.h \
     openremotedlg.h \
     httpthread.h \
     util.h \
@@ -89,6 +93,7 @@ HEADERS = rti.h \
     configdlg.h \
     pyramid.h \
     hsh.h \
+    quantizedlevel.h \
     universalrti.h \
     multiviewrti.h \
     defaultrendering.h \
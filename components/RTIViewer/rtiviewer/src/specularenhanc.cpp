@@ -109,6 +109,12 @@ bool SpecularEnhancement::enabledLighting()
 }
 
 
+int SpecularEnhancement::normalsUsage()
+{
+	return VIEW_NORMALS;
+}
+
+
 float SpecularEnhancement::getKd()
 {
     // Get kd as a value normalized to the range [0,100]
@@ -241,7 +247,7 @@ void SpecularEnhancement::applyHSH(const PyramidCoeffF& redCoeff, const PyramidC
 	const float* bluePtr = blueCoeff.getLevel(info.level);
 	const vcg::Point3f* normalsPtr = normals.getLevel(info.level);
 	int tempW = mipMapSize[info.level].width();
-    float hweights[9];
+    float hweights[HSH_MAX_TERMS];
 	vcg::Point3d temp(info.light.X(), info.light.Y(), info.light.Z());
 	temp.Normalize();
 	float phi = atan2(temp.Y(), temp.X());
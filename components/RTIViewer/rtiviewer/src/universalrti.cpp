@@ -143,9 +143,11 @@ int UniversalRti::load(QString name, CallBackPos *cb)
         default: type = "RTI"; return -1;
 	}
     QString text = "Loading RTI...";
+	// The file name lets the image map its coefficients from the file.
+	image->setFileName(filename);
 	int ret = image->loadData(file, w, h, basisTerm, true, cb, text);
 	if (ret != 0)
-		return -1;
+		return ret == -2 ? -2 : -1;
 
 	if (cb != NULL)	(*cb)(99, "Done");
 
@@ -101,6 +101,12 @@ bool UnsharpMasking::enabledLighting()
 }
 
 
+int UnsharpMasking::normalsUsage()
+{
+	return VIEW_NORMALS;
+}
+
+
 float UnsharpMasking::getGain()
 {
     // Get gain as a value normalized to the range [0,100]
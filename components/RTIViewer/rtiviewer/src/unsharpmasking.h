@@ -95,6 +95,7 @@ public:
 	virtual bool isLightInteractive();
 	virtual bool supportRemoteView();
 	virtual bool enabledLighting();
+	virtual int normalsUsage();
 
 	virtual void applyPtmLRGB(const PyramidCoeff& coeff, const PyramidRGB& rgb, const QSize* mipMapSize, const PyramidNormals& normals, const RenderingInfo& info, unsigned char* buffer);
 
@@ -40,6 +40,8 @@
 
 #include <stdio.h>
 
+#include <hsh_basis.h>
+
 #define CHUNK 128
 
 /*!
@@ -502,35 +504,14 @@ static int computeMaximumOnCircle(float* a, float &lx, float &ly)
 }
 
 /*!
-  Returns the first nine Hemispherical Harmonics computed in the theta and phi angles.
+  Returns the first order*order Hemispherical Harmonics computed in the theta and phi angles.
+  The basis is shared with the HSH fitter (hsh_basis.h), orders above HSH_MAX_ORDER are clamped.
 */
 static void getHSH(float theta, float phi, float* hweights, int order)
 {
-	float cosPhi = cos(phi);
-	float cosTheta = cos(theta);
-	float cosTheta2 = cosTheta * cosTheta;
-	hweights[0] = 1/sqrt(2*M_PI);
-	hweights[1] = sqrt(6/M_PI)      *  (cosPhi*sqrt(cosTheta-cosTheta2));
-	hweights[2] = sqrt(3/(2*M_PI))  *  (-1. + 2.*cosTheta);
-	hweights[3] = sqrt(6/M_PI)      *  (sqrt(cosTheta - cosTheta2)*sin(phi));
-	if (order > 2)
-	{
-		hweights[4] = sqrt(30/M_PI)     *  (cos(2.*phi)*(-cosTheta + cosTheta2));
-		hweights[5] = sqrt(30/M_PI)     *  (cosPhi*(-1. + 2.*cosTheta)*sqrt(cosTheta - cosTheta2));
-		hweights[6] = sqrt(5/(2*M_PI))  *  (1 - 6.*cosTheta + 6.*cosTheta2);
-		hweights[7] = sqrt(30/M_PI)     *  ((-1 + 2.*cosTheta)*sqrt(cosTheta - cosTheta2)*sin(phi));
-		hweights[8] = sqrt(30/M_PI)     *  ((-cosTheta + cosTheta2)*sin(2.*phi));
-	}
-	if (order > 3)
-	{
-		hweights[9]  = 2*sqrt(35/M_PI)	*	(cos(3.0*phi)*pow((cosTheta - cosTheta2), (float)1.5));
-		hweights[10] = sqrt(210/M_PI)	*	(cos(2.0*phi)*(-1 + 2*cosTheta)*(-cosTheta + cosTheta2));
-		hweights[11] = 2*sqrt(21/M_PI)  *	(cos(phi)*sqrt(cosTheta - cosTheta2)*(1 - 5*cosTheta + 5*cosTheta2));
-		hweights[12] = sqrt(7/(2*M_PI)) *	(-1 + 12*cosTheta - 30*cosTheta2 + 20*cosTheta2*cosTheta);
-		hweights[13] = 2*sqrt(21/M_PI)  *	(sqrt(cosTheta - cosTheta2)*(1 - 5*cosTheta + 5*cosTheta2)*sin(phi));
-		hweights[14] = sqrt(210/M_PI)  *	(-1 + 2*cosTheta)*(-cosTheta + cosTheta2)*sin(2*phi);
-		hweights[15] = 2*sqrt(35/M_PI)  *	pow((cosTheta - cosTheta2), (float)1.5)*sin(3*phi);
-	}
+	if (order > HSH_MAX_ORDER)
+		order = HSH_MAX_ORDER;
+	hsh_basis(theta, phi, order, hweights);
 }
 
 
@@ -30,6 +30,7 @@ macx-g++:QMAKE_CFLAGS += -O3 -fopenmp -funroll-loops -ffast-math -fforce-addr -f
 INCLUDEPATH    += ../../../../vcglib \
                   ../../rtiviewer/src \
                   ../../compression/src/ \
+                  ../../../HSHfitter2/src \
 
 
 SOURCES        =  \
@@ -44,6 +45,7 @@ SOURCES        =  \
                ../../rtiviewer/src/detailenhanc.cpp\
                ../../rtiviewer/src/dyndetailenhanc.cpp\
                ../../rtiviewer/src/hsh.cpp\
+               ../../rtiviewer/src/quantizedlevel.cpp\
                ../../rtiviewer/src/universalrti.cpp\
                ../../rtiviewer/src/normalsrendering.cpp\
                ../../rtiviewer/src/rendercontrolutils.cpp
@@ -62,6 +64,7 @@ HEADERS        = \
                ../../rtiviewer/src/dyndetailenhanc.h\
                ../../rtiviewer/src/defaultrendering.h\
                ../../rtiviewer/src/hsh.h\
+               ../../rtiviewer/src/quantizedlevel.h\
                ../../rtiviewer/src/universalrti.h\
                ../../rtiviewer/src/normalsrendering.h\
                ../../rtiviewer/src/rendercontrolutils.h